@@ -20,6 +20,13 @@
 #define NRF_SPEED         1000000
 //#define AUTO_ACK
 
+// Download profile, negotiated with DL_OPT_FAST. The reader is close by
+// during a download, so trade range for speed. Pings keep the settings
+// above for range.
+#define FAST_SPEED        RF24_2MBPS
+#define FAST_RETRY_DELAY  1     // (n + 1) * 250 us between hw retries
+#define FAST_RETRY_COUNT  15
+
 // ====================================================================
 // The following are defaults to be written to EEPROM. They can be
 // reconfigured later over-the-air using CMD_SETTINGS
@@ -42,6 +49,12 @@
 #define SESSION_TIMEOUT_SECS    120
 #define AUTO_STOP_SECONDS       43200 // auto-stop after 12 hours 
 
+// what to do when the session log in EEPROM is full
+#define OVERFLOW_OVERWRITE      0     // overwrite the oldest sessions
+#define OVERFLOW_DROP           1     // drop new sessions
+#define OVERFLOW_STOP           2     // stop the tag
+#define OVERFLOW_POLICY         OVERFLOW_DROP
+
 // PING radio parameters
 #define PING_TX_POWER     2      // (0, 1, 2, 3) -> (0, -6, -12, -18 dBm)
                                 // -> (red, green, yellow, blue)
@@ -74,6 +87,97 @@
 #define PKT_DATA          0xA9  // this is a data packet
 #define CMD_WRITE_SETTING 0xAA  // configure device EEPROM metadata
 #define CMD_READ_SETTINGS 0xAB
+#define PKT_INDEX         0xAC  // record count etc. sent ahead of the data
+#define PKT_BULK          0xAD  // several records, numbered for retransmit
+#define PKT_WINDOW        0xAE  // end of a window of PKT_BULK, ack it
+#define CMD_WINDOW_ACK    0xAF  // bitmap of the PKT_BULK of a window received
+#define PKT_PACKED        0xB0  // PKT_BULK with packed records
+#define PKT_DICT          0xB1  // peer dictionary, packet 0 of a packed upload
+#define CMD_BROADCAST     0xB2  // a command for the tags in a bitmap
+#define CMD_INVENTORY     0xB3  // slot beacon of an inventory
+#define PKT_INVENTORY     0xB4  // a tag's reply in its inventory slot
+
+// Download options, the byte after the tag id of a download command
+#define DL_OPT_BULK       0x01  // send PKT_BULK rather than PKT_DATA
+#define DL_OPT_FAST       0x02  // switch to the download profile after PKT_INDEX
+#define DL_OPT_NEW        0x04  // only records the tag has not had acked yet
+#define DL_OPT_SINCE      0x08  // records from the sequence number(4) that follows
+#define DL_OPT_RUN        0x10  // keep the tag running after the download
+#define DL_OPT_PACK       0x20  // with DL_OPT_BULK, send PKT_PACKED
+
+// PKT_BULK = [PKT_BULK, seq(2), count, now(4)] and count records of
+// [tagid(2), first seen(4), duration(2)]. Times are seconds since the
+// tag started. Windows start at multiples of BULK_WINDOW packets.
+#define BULK_HEADER_LEN   8
+#define BULK_RECORD_LEN   8
+#define BULK_RECORDS      3     // records per PKT_BULK, fills 32 bytes
+#define BULK_WINDOW       8     // PKT_BULK per window, a power of 2 <= 8
+
+// PKT_PACKED has the PKT_BULK header and count packed records of
+//   peer      index of the tag id in the dictionary, or PACK_LITERAL
+//             followed by the tag id(2)
+//   first     first seen, zigzag varint of the difference to the record
+//             before it in the packet (to 0 for the first one)
+//   duration  varint
+// Varints hold 7 bits per byte, low bits first, with the high bit set
+// on all but the last byte. PKT_DICT has the PKT_BULK header and count
+// tag ids(2), the peers seen most in the upload.
+#define PACK_DICT_SIZE    8
+#define PACK_LITERAL      0xFF
+#define PACK_RECORD_MAX   11    // peer(3), first(5), duration(3)
+
+// CMD_BROADCAST = [CMD_BROADCAST, base tag id(2), command, data(4)] and
+// a bitmap of the tags base to base + BROADCAST_TAGS - 1 it is for, low
+// bit first. Sent on the reader channel, tags run it like the command
+// sent to them (START, STOP or WRITE_SETTING) and ack in a random one of
+// BROADCAST_SLOTS slots after it.
+#define BROADCAST_HEADER_LEN  8
+#define BROADCAST_DATA_LEN    4
+#define BROADCAST_TAGS        192   // bitmap fills 32 bytes
+#define BROADCAST_SLOTS       4
+#define BROADCAST_SLOT_MS     3
+
+// CMD_INVENTORY = [CMD_INVENTORY, round(2), Q, frame, acked tag id(2)]
+// starts each slot of a frame of 2^Q slots. A tag picks a random slot of
+// the frame and replies PKT_INVENTORY = [PKT_INVENTORY, tagid(2),
+// round(2)] in it. The next beacon acks the reply, and the tag keeps
+// quiet for the rest of the round. Frames with a new number restart the
+// slot count.
+#define INVENTORY_MAX_Q       7
+
+// the reader listens for acks between broadcasts, for all slots and a
+// settings write, and gives up after four reader periods of the tags
+#define BROADCAST_LISTEN_MS   15
+#define BROADCAST_TIMEOUT_MS  (READER_PERIOD_SECS * 4000UL + 1000)
+
+// Inventory: slots are long enough for a beacon and a reply. Q starts at
+// INVENTORY_Q and moves by INVENTORY_C / 16 per collision or empty slot.
+// It ends once no tag replied for a reader period of the tags.
+#define INVENTORY_SLOT_MS     3
+#define INVENTORY_Q           4
+#define INVENTORY_C           5
+#define INVENTORY_IDLE_MS     (READER_PERIOD_SECS * 1000UL + 1000)
+#define DOWNLOAD_QUEUE_SIZE   16
+
+// Wait this long for the first packet of a download. For part of its
+// log the tag goes through the records to index them before it sends
+// anything, about 0.1 ms a record.
+#define DOWNLOAD_WAIT_MS      3000
+
+// Auto-download. While the reader downloads a tag, it pings on the reader
+// channel between records, at most every SCOUT_PERIOD_MS, while the
+// serial port drains. These pings set the busy field, CMD_PING =
+// [CMD_PING, reader id(2), 0, busy]: tags that hear it answer once with
+// [CMD_PING, tag id(2), PING_WAITING], which queues them, and come back
+// in about busy * READER_BUSY_MS, when the download should be done. The
+// records are printed at 9600 baud, about 32 records/s, which bounds the
+// download rate however many tags are waiting. A round ends once
+// COLLECTED_TAGS tags are downloaded, and the next one starts afresh.
+#define SCOUT_PERIOD_MS       READER_DURATION
+#define SCOUT_LISTEN_MS       3
+#define READER_BUSY_MS        100
+#define PING_WAITING          0x02
+#define COLLECTED_TAGS        16    // skipped for the rest of the round
 
 #define SET_PING_TX_RANGE       0
 #define SET_PING_CHANNEL        1
@@ -84,6 +188,7 @@
 #define SET_READER_PERIOD_S     6
 #define SET_SESSION_TIMEOUT_S   7
 #define SET_DEFAULTS            8 // reset settings to default
+#define SET_OVERFLOW_POLICY     9
 
 // *******************  Utility macros
 #define IS_LOCATOR(tagid) (tagid > MAX_TAG_ID) 
@@ -111,6 +216,7 @@ struct MetaData {
   unsigned int listenPeriodSecs;
   unsigned int readerPeriodSecs;
   unsigned int sessionTimeoutSecs;
+  byte overflowPolicy; // OVERFLOW_OVERWRITE, OVERFLOW_DROP or OVERFLOW_STOP
 };
 
 #endif
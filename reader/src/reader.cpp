@@ -53,7 +53,8 @@ void loop() {
 
 byte radioRead() {
   if (radio.available()) {
-    radio.read(inbuf, radio.getPayloadSize());
+    byte len = fastLink ? radio.getDynamicPayloadSize() : radio.getPayloadSize();
+    radio.read(inbuf, len);
 
     #ifdef DEBUG
       Serial.print("< ");
@@ -64,7 +65,7 @@ byte radioRead() {
       Serial.println("");
     #endif
 
-    return radio.getPayloadSize();
+    return len;
   }
 
   return 0;
@@ -77,7 +78,7 @@ void radioWrite(const byte *buf, uint8_t len) {
 }
 
 unsigned int sendCommand(byte command) {
-  sendCommand(command, 0, 0);
+  return sendCommand(command, 0, 0);
 }
 
 unsigned int sendCommand(byte command, byte *data, int dataLen) {
@@ -124,11 +125,31 @@ byte getBatteryPercentage(byte batteryLevel) {
   return map(batteryLevel, 0, 255, 0, 100);  
 }
 
+// download the records the tag has not had acked yet
 boolean downloadTagData(unsigned int remoteTagId, boolean stopAfter, boolean resetAfter) {
+  return downloadTagData(remoteTagId, stopAfter, resetAfter, DL_OPT_NEW, 0);
+}
+
+// Download tag data. range is 0 for the whole log, DL_OPT_NEW, or
+// DL_OPT_SINCE to download from record sequence number since on. The tag resets its data only
+// once all records are acked.
+boolean downloadTagData(unsigned int remoteTagId, boolean stopAfter, boolean resetAfter,
+    byte range, unsigned long since) {
+  byte command = resetAfter ? CMD_DL_AND_RESET : CMD_DOWNLOAD;
+
+  // older tags ignore the options, they send PKT_DATA at the ping rate
+  byte data[5];
+  data[0] = DL_OPT_BULK | DL_OPT_FAST | DL_OPT_PACK | range;
+  if (!stopAfter) data[0] |= DL_OPT_RUN;
+  data[1] = since >> 24;
+  data[2] = since >> 16;
+  data[3] = since >> 8;
+  data[4] = since;
+
   if (remoteTagId == 0) {
-    remoteTagId = sendCommand(CMD_DL_AND_RESET);
+    remoteTagId = sendCommand(command, data, sizeof(data));
   } else {
-    sendCommandForTag(CMD_DL_AND_RESET, remoteTagId);
+    sendCommandForTag(command, remoteTagId, data, sizeof(data));
   }
 
   if (remoteTagId > 0) {
@@ -142,11 +163,21 @@ boolean downloadTagData(unsigned int remoteTagId, boolean stopAfter, boolean res
 boolean processDownloadData(unsigned int tagid) {
   // wait for data
   unsigned long timer2 = millis();
-  while (millis() - timer2 < 1000) {
+  while (millis() - timer2 < DOWNLOAD_WAIT_MS) {
     if (radio.available()) break;  
   }
 
   boolean ret = false;
+  boolean indexed = false; // tag sent an index ahead of the data
+  unsigned long expected = 0;
+  unsigned int expectedChecksum = 0;
+  unsigned long received = 0;
+  unsigned int checksum = 0;
+  unsigned int windowBase = 0; // first PKT_BULK of the current window
+  byte windowBits = 0; // PKT_BULK of the window received so far
+  unsigned int dict[PACK_DICT_SIZE]; // peers of a packed upload
+  boolean dictReady = false;
+  unsigned long started = millis();
   if (radio.available()) {
     byte count = 0;
     unsigned long timer1 = millis();
@@ -155,22 +186,127 @@ boolean processDownloadData(unsigned int tagid) {
         unsigned int remoteTagId = getRemoteTagId(inbuf);
         if (inbuf[0] == CMD_ACK) {
           // done
-          Serial.println("Download complete");
           ret = true;
           break;
+        } else if (inbuf[0] == PKT_INDEX) {
+          // the tag follows once it has the ack, a repeat is harmless
+          if (inbuf[15] & DL_OPT_FAST) setFastLink(true);
+          timer1 = millis(); // reset timeout
+          indexed = true;
+          expected = toULong(inbuf[1], inbuf[2], inbuf[3], inbuf[4]);
+          expectedChecksum = ((unsigned int)inbuf[13] << 8) | inbuf[14];
+          Serial.print("Records: ");
+          Serial.print(expected, DEC);
+          Serial.print(" from ");
+          Serial.print(toULong(inbuf[5], inbuf[6], inbuf[7], inbuf[8]), DEC);
+          Serial.print(" to ");
+          Serial.println(toULong(inbuf[9], inbuf[10], inbuf[11], inbuf[12]), DEC);
+          // sequence numbers to download since next time
+          Serial.print("Log records ");
+          Serial.print(toULong(inbuf[16], inbuf[17], inbuf[18], inbuf[19]), DEC);
+          Serial.print(" to ");
+          Serial.println(toULong(inbuf[20], inbuf[21], inbuf[22], inbuf[23]), DEC);
         } else if (inbuf[0] == PKT_DATA) {
           timer1 = millis(); // reset timeout
-          // print out data for collation
-          Serial.print("|"); // indicates data line - do not use elsewhere
-          Serial.print(tagid, DEC);
-          Serial.print("|");
-          Serial.print(remoteTagId, DEC);
-          Serial.print("|");
-          Serial.print(toULong(inbuf[3], inbuf[4], inbuf[5], inbuf[6]), DEC);
-          Serial.print("|");
-          Serial.print(toULong(inbuf[7], inbuf[8], inbuf[9], inbuf[10]), DEC);
-          Serial.print("|");
-          Serial.println(toULong(inbuf[11], inbuf[12], inbuf[13], inbuf[14]), DEC);
+          received++;
+          checksum += remoteTagId + (unsigned int)(
+              toULong(inbuf[7], inbuf[8], inbuf[9], inbuf[10]) -
+              toULong(inbuf[3], inbuf[4], inbuf[5], inbuf[6]));
+          printRecord(tagid, remoteTagId,
+              toULong(inbuf[3], inbuf[4], inbuf[5], inbuf[6]),
+              toULong(inbuf[7], inbuf[8], inbuf[9], inbuf[10]),
+              toULong(inbuf[11], inbuf[12], inbuf[13], inbuf[14]));
+          if (indexed && received % 100 == 0) {
+            Serial.print("Received ");
+            Serial.print(received, DEC);
+            Serial.print(" of ");
+            Serial.println(expected, DEC);
+          }
+          if (indexed && received == expected) {
+            // everything is here, don't wait for the ack to time out
+            ret = true;
+          }
+        } else if (inbuf[0] == PKT_BULK || inbuf[0] == PKT_PACKED || inbuf[0] == PKT_DICT) {
+          timer1 = millis(); // reset timeout
+          // left unacked until the dictionary is in, so the tag sends it again
+          if (inbuf[0] == PKT_PACKED && !dictReady) continue;
+          unsigned int seq = ((unsigned int)inbuf[1] << 8) | inbuf[2];
+          int offset = (int)(seq - windowBase);
+          if (offset < 0) continue; // resent after its window was acked
+          if (offset >= BULK_WINDOW) {
+            // the tag moved on to the next window
+            windowBase = seq & ~(BULK_WINDOW - 1);
+            windowBits = 0;
+            offset = seq - windowBase;
+          }
+          if (windowBits & (1 << offset)) continue; // resent, printed already
+          windowBits |= 1 << offset;
+
+          unsigned long now = toULong(inbuf[4], inbuf[5], inbuf[6], inbuf[7]);
+          if (inbuf[0] == PKT_DICT) {
+            for (byte k = 0; k < PACK_DICT_SIZE; k++) {
+              byte *r = &inbuf[BULK_HEADER_LEN + k * 2];
+              dict[k] = ((unsigned int)r[0] << 8) | r[1];
+            }
+            dictReady = true;
+            continue;
+          }
+
+          byte j = BULK_HEADER_LEN;
+          unsigned long first = 0;
+          for (byte k = 0; k < inbuf[3] && j < sizeof(inbuf); k++) {
+            unsigned int remote;
+            unsigned int duration;
+            if (inbuf[0] == PKT_BULK) {
+              byte *r = &inbuf[j];
+              remote = ((unsigned int)r[0] << 8) | r[1];
+              first = toULong(r[2], r[3], r[4], r[5]);
+              duration = ((unsigned int)r[6] << 8) | r[7];
+              j += BULK_RECORD_LEN;
+            } else {
+              if (inbuf[j] == PACK_LITERAL) {
+                remote = ((unsigned int)inbuf[j + 1] << 8) | inbuf[j + 2];
+                j += 3;
+              } else {
+                remote = dict[inbuf[j++] % PACK_DICT_SIZE];
+              }
+              unsigned long delta = getVarint(inbuf, &j);
+              first += (delta >> 1) ^ (0UL - (delta & 1)); // zigzag
+              duration = getVarint(inbuf, &j);
+            }
+            received++;
+            checksum += remote + duration;
+            printRecord(tagid, remote, first, first + duration, now);
+            // when this download should be done, from the rate so far
+            unsigned long left = READER_PERIOD_SECS * 1000UL;
+            if (indexed) {
+              left = expected > received ?
+                  (millis() - started) / received * (expected - received) : 0;
+            }
+            scoutForTags(left); // while the line drains
+            if (indexed && received % 100 == 0) {
+              Serial.print("Received ");
+              Serial.print(received, DEC);
+              Serial.print(" of ");
+              Serial.println(expected, DEC);
+            }
+          }
+        } else if (inbuf[0] == PKT_WINDOW && remoteTagId == tagid) {
+          // tell the tag which packets of the window to send again
+          timer1 = millis(); // reset timeout
+          unsigned int base = ((unsigned int)inbuf[3] << 8) | inbuf[4];
+          if (base != windowBase) {
+            // none of the window arrived
+            windowBase = base;
+            windowBits = 0;
+          }
+          byte ack[] = { CMD_WINDOW_ACK, (byte)(tagid >> 8), (byte)(tagid & 0xFF),
+              inbuf[3], inbuf[4], windowBits };
+          radioWrite(ack, sizeof(ack));
+          if (indexed && received == expected) {
+            // the tag got the last ack, or will give up polling
+            ret = true;
+          }
         } else {
           Serial.print("Unknown command ");
           Serial.println(inbuf[0], HEX);
@@ -179,9 +315,64 @@ boolean processDownloadData(unsigned int tagid) {
     }
   }
 
+  if (indexed && received < expected) {
+    Serial.print("Download truncated, received ");
+    Serial.print(received, DEC);
+    Serial.print(" of ");
+    Serial.println(expected, DEC);
+    ret = false;
+  } else if (indexed && checksum != expectedChecksum) {
+    Serial.println("Download checksum mismatch");
+    ret = false;
+  } else if (ret) {
+    Serial.println("Download complete");
+  }
+
+  roundRecords += received;
+  unsigned long elapsed = millis() - started;
+  if (received > 0 && elapsed > 0) {
+    Serial.print("Throughput: ");
+    Serial.print(received, DEC);
+    Serial.print(" records in ");
+    Serial.print(elapsed, DEC);
+    Serial.print(" ms, ");
+    Serial.print(received * 1000 / elapsed, DEC);
+    Serial.println(" records/s");
+  }
+
+  setFastLink(false);
   return ret;
 }
 
+// Switch to the download profile and back, as the tag does
+void setFastLink(boolean fast) {
+  if (fast) {
+    radio.setDataRate(FAST_SPEED);
+    radio.enableDynamicPayloads();
+    radio.setRetries(FAST_RETRY_DELAY, FAST_RETRY_COUNT);
+  } else {
+    radio.setDataRate(RF24_1MBPS);
+    radio.disableDynamicPayloads();
+    radio.setRetries(5, 15); // RF24 defaults
+  }
+  fastLink = fast;
+}
+
+// print out a record for collation
+void printRecord(unsigned int tagid, unsigned int remoteTagId,
+    unsigned long first, unsigned long last, unsigned long now) {
+  Serial.print("|"); // indicates data line - do not use elsewhere
+  Serial.print(tagid, DEC);
+  Serial.print("|");
+  Serial.print(remoteTagId, DEC);
+  Serial.print("|");
+  Serial.print(first, DEC);
+  Serial.print("|");
+  Serial.print(last, DEC);
+  Serial.print("|");
+  Serial.println(now, DEC);
+}
+
 void sendReaderPing() {
   if (millis() - lastPing >= (READER_DURATION / 2)) {
     lastPing = millis();
@@ -195,7 +386,9 @@ void listenForTags() {
     unsigned int remoteTagId = getRemoteTagId(inbuf);
     boolean strong = radio.testRPD();
 
-    if (inbuf[0] == CMD_PING && strong) {
+    // after an inventory only the tags it queued, and each tag once a round.
+    // A waiting tag answered a busy ping and is not listening.
+    if (inbuf[0] == CMD_PING && inbuf[3] != PING_WAITING && strong && wantTag(remoteTagId)) {
       radio.setChannel(DOWNLOAD_CHANNEL);
       delay(5);
 
@@ -204,6 +397,14 @@ void listenForTags() {
       
       if (downloadTagData(remoteTagId, true, true)) {
         Serial.println("Done");
+        collected[collectedCount++] = remoteTagId;
+        roundTags++;
+        if (queued > 0 && dequeueTag(remoteTagId) && queued == 0) {
+          Serial.println("All queued tags downloaded");
+          queueOnly = false;
+        }
+        printRound();
+        if (collectedCount >= COLLECTED_TAGS) startRound();
       }
 
       radio.setChannel(READER_CHANNEL);
@@ -214,6 +415,226 @@ void listenForTags() {
   }      
 }
 
+// Not collected in this round yet and, after an inventory, one it queued
+boolean wantTag(unsigned int tagid) {
+  for (byte j=0; j < collectedCount; j++) {
+    if (collected[j] == tagid) return false;
+  }
+  return !queueOnly || findQueued(tagid) < queued;
+}
+
+// Ping on the reader channel while the serial port drains the records
+// just printed. The busy field turns the tags that hear it away until
+// busyMs from now, when this download should be done, and the reader
+// pings for them again. They answer with PING_WAITING and are queued.
+// Download packets already in the RX FIFO came in on the download
+// channel and must stay there, so the answers are only read if the FIFO
+// was empty.
+void scoutForTags(unsigned long busyMs) {
+  byte ping[5];
+
+  if (!autoDownload || millis() - lastScout < SCOUT_PERIOD_MS) return;
+  lastScout = millis();
+
+  unsigned long busy = busyMs / READER_BUSY_MS + 1;
+  memset(ping, 0, sizeof(ping));
+  memcpy(ping, ping_packet, sizeof(ping_packet));
+  ping[4] = busy < 255 ? busy : 255;
+
+  boolean fast = fastLink;
+  if (fast) setFastLink(false);
+  radio.setChannel(READER_CHANNEL);
+  radio.setAutoAck(false);
+  boolean listen = !radio.available();
+  radioWrite(ping, sizeof(ping));
+
+  // into ping, inbuf holds the records being printed
+  unsigned long timer = millis();
+  while (listen && millis() - timer < SCOUT_LISTEN_MS) {
+    if (!radio.available()) continue;
+    radio.read(ping, sizeof(ping));
+    if (ping[0] == CMD_PING && ping[3] == PING_WAITING) {
+      unsigned int tagid = getRemoteTagId(ping);
+      if (!queueOnly && wantTag(tagid)) queueTag(tagid);
+    }
+  }
+
+  radio.setChannel(DOWNLOAD_CHANNEL);
+  radio.setAutoAck(true);
+  if (fast) setFastLink(true);
+}
+
+// start counting an auto-download round afresh, no tag collected yet
+void startRound() {
+  collectedCount = 0;
+  if (!queueOnly) queued = 0; // tags scouted last round, some may be gone
+  roundStarted = millis();
+  roundRecords = 0;
+  roundTags = 0;
+}
+
+void printRound() {
+  unsigned long elapsed = millis() - roundStarted;
+  if (elapsed == 0) return;
+
+  Serial.print("Round: ");
+  Serial.print(roundTags, DEC);
+  Serial.print(" tags, ");
+  Serial.print(roundRecords, DEC);
+  Serial.print(" records in ");
+  Serial.print(elapsed / 1000, DEC);
+  Serial.print(" s, ");
+  Serial.print(roundRecords * 1000 / elapsed, DEC);
+  Serial.print(" records/s, ");
+  printTenths(roundTags * 600000UL / elapsed); // a round has COLLECTED_TAGS at most
+  Serial.print(" tags/min, ");
+  Serial.print(queued, DEC);
+  Serial.println(" waiting");
+}
+
+// index of a tag in the download queue, queued if it is not in it
+byte findQueued(unsigned int tagid) {
+  byte j = 0;
+  while (j < queued && downloadQueue[j] != tagid) j++;
+  return j;
+}
+
+// add a tag to the download queue, false if it is in it already or full
+boolean queueTag(unsigned int tagid) {
+  if (findQueued(tagid) < queued || queued >= DOWNLOAD_QUEUE_SIZE) return false;
+  downloadQueue[queued++] = tagid;
+  return true;
+}
+
+boolean dequeueTag(unsigned int tagid) {
+  byte j = findQueued(tagid);
+  if (j >= queued) return false;
+  downloadQueue[j] = downloadQueue[--queued];
+  return true;
+}
+
+// Enumerate the tags in range, like the RFID Q algorithm. Each slot of a
+// frame of 2^Q slots starts with a beacon, tags reply in a random slot,
+// and the next beacon acks a reply that came through alone. A strong
+// carrier with no valid packet is a collision. Q goes up on collisions
+// and down on empty slots. Runs until no tag replied for a reader period
+// of the tags, and queues the tags found for auto-download as long as
+// the queue has room. Returns the number of tags found.
+unsigned int inventory() {
+  byte beacon[32];
+  unsigned int round = (unsigned int)micros() | 1; // 0 = none on the tags
+  byte q = INVENTORY_Q;
+  byte qfp = INVENTORY_Q * 16; // Q in 1/16 steps
+  byte frame = 0;
+  unsigned int slotsLeft = 1 << q;
+  unsigned int acked = 0;
+  unsigned int found = 0;
+  unsigned int singles = 0;
+  unsigned int collisions = 0;
+  unsigned int empty = 0;
+  unsigned int unqueued = 0;
+
+  memset(beacon, 0, sizeof(beacon));
+  beacon[0] = CMD_INVENTORY;
+  beacon[1] = round >> 8;
+  beacon[2] = round & 0xFF;
+
+  Serial.println("Inventory of tags in range...");
+  if (!queueOnly) queued = 0; // only the tags it finds
+  radio.setChannel(READER_CHANNEL);
+  radio.setAutoAck(false);
+  radio.startListening();
+  while (radioRead() > 0); // clear read buffer
+
+  unsigned long started = millis();
+  unsigned long lastFound = started;
+  unsigned long lastReply = started;
+  while (millis() - lastReply < INVENTORY_IDLE_MS) {
+    beacon[3] = q;
+    beacon[4] = frame;
+    beacon[5] = acked >> 8;
+    beacon[6] = acked & 0xFF;
+    radioWrite(beacon, sizeof(beacon));
+    acked = 0;
+
+    // RPD follows the carrier, sample it while the replies are on air
+    boolean carrier = false;
+    unsigned long slot = millis();
+    while (millis() - slot < INVENTORY_SLOT_MS) {
+      if (radio.testRPD()) carrier = true;
+    }
+
+    byte replies = 0;
+    unsigned int tagid = 0;
+    while (radioRead() > 0) {
+      if (inbuf[0] == PKT_INVENTORY && inbuf[3] == beacon[1] && inbuf[4] == beacon[2]) {
+        tagid = getRemoteTagId(inbuf);
+        replies++;
+      }
+    }
+
+    if (replies == 1) {
+      singles++;
+      acked = tagid;
+      lastReply = millis();
+      // a queued tag that replies again missed its ack. Past a full queue
+      // tags are still acked and counted, one that misses its ack twice
+      if (findQueued(tagid) >= queued) {
+        found++;
+        lastFound = lastReply;
+        if (!queueTag(tagid)) unqueued++;
+        Serial.print("+");
+        Serial.println(tagid, DEC);
+      }
+    } else if (replies > 1 || carrier) {
+      collisions++;
+      lastReply = millis();
+      if (qfp <= INVENTORY_MAX_Q * 16 - INVENTORY_C) qfp += INVENTORY_C;
+    } else {
+      empty++;
+      if (qfp >= INVENTORY_C) qfp -= INVENTORY_C;
+    }
+
+    // a new frame once its slots are used, or Q changed
+    byte next = (qfp + 8) / 16;
+    if (--slotsLeft == 0 || next != q) {
+      q = next;
+      frame++;
+      slotsLeft = 1 << q;
+    }
+  }
+
+  unsigned long elapsed = lastFound - started;
+  Serial.print("Found ");
+  Serial.print(found, DEC);
+  Serial.print(" tags in ");
+  Serial.print(elapsed, DEC);
+  Serial.print(" ms");
+  if (elapsed > 0) {
+    Serial.print(", ");
+    printTenths(found * 10000UL / elapsed);
+    Serial.print(" tags/s");
+  }
+  Serial.println("");
+  Serial.print("Slots: ");
+  Serial.print(singles, DEC);
+  Serial.print(" replies, ");
+  Serial.print(collisions, DEC);
+  Serial.print(" collisions, ");
+  Serial.print(empty, DEC);
+  Serial.println(" empty");
+  Serial.print(queued, DEC);
+  Serial.println(" tags queued for auto-download");
+  if (unqueued > 0) {
+    Serial.print("Queue full, ");
+    Serial.print(unqueued, DEC);
+    Serial.println(" tags not queued");
+  }
+  if (queued > 0) queueOnly = true;
+
+  return found;
+}
+
 void rangeTester() {
   Serial.println("Range tester - showing devices in range");
   radio.setChannel(PING_CHANNEL);
@@ -271,6 +692,107 @@ void broadcastCommand(byte command, char *description) {
   Serial.println(" done.");
 }
 
+// Send a command to the tags base to base + count - 1 at once. Tags look
+// for a reader every few seconds, so the broadcast repeats, with the tags
+// that acked taken out of its bitmap, until all acked or it times out.
+// Lists the tags that did not ack, and returns how many there are.
+unsigned int broadcastTags(byte command, unsigned int base, unsigned int count,
+    byte *data, int dataLen) {
+  byte packet[32];
+  unsigned int pending = count;
+
+  memset(packet, 0, sizeof(packet));
+  packet[0] = CMD_BROADCAST;
+  packet[1] = base >> 8;
+  packet[2] = base & 0xFF;
+  packet[3] = command;
+  for (int i=0; i < dataLen && i < BROADCAST_DATA_LEN; i++) {
+    packet[4 + i] = data[i];
+  }
+  for (unsigned int i=0; i < count; i++) {
+    packet[BROADCAST_HEADER_LEN + i / 8] |= 1 << (i % 8);
+  }
+
+  Serial.print("Broadcasting to ");
+  Serial.print(count, DEC);
+  Serial.println(" tags");
+  radio.setChannel(READER_CHANNEL);
+  radio.setAutoAck(false);
+  radio.startListening();
+  while (radioRead() > 0); // clear read buffer
+
+  unsigned long started = millis();
+  while (pending > 0 && millis() - started < BROADCAST_TIMEOUT_MS) {
+    radioWrite(packet, sizeof(packet));
+
+    // the tags that heard it ack in one of the slots after it
+    unsigned long timer = millis();
+    while (millis() - timer < BROADCAST_LISTEN_MS) {
+      if (radioRead() > 2 && inbuf[0] == CMD_ACK) {
+        unsigned int offset = getRemoteTagId(inbuf) - base;
+        byte bit = 1 << (offset % 8);
+        if (offset < count && (packet[BROADCAST_HEADER_LEN + offset / 8] & bit)) {
+          packet[BROADCAST_HEADER_LEN + offset / 8] &= ~bit;
+          pending--;
+          Serial.print("+");
+          Serial.println(base + offset, DEC);
+        }
+      }
+    }
+  }
+
+  Serial.print(count - pending, DEC);
+  Serial.print(" of ");
+  Serial.print(count, DEC);
+  Serial.print(" tags acked in ");
+  Serial.print(millis() - started, DEC);
+  Serial.println(" ms");
+  if (pending > 0) {
+    Serial.print("No reply:");
+    for (unsigned int i=0; i < count; i++) {
+      if (packet[BROADCAST_HEADER_LEN + i / 8] & (1 << (i % 8))) {
+        Serial.print(" ");
+        Serial.print(base + i, DEC);
+      }
+    }
+    Serial.println("");
+  }
+
+  return pending;
+}
+
+// Pick the tags for a broadcast and the command to send them
+void broadcastMenu() {
+  Serial.print("First tag id: ");
+  unsigned int base = readInput();
+  Serial.println(base, DEC);
+  Serial.print("Number of tags: ");
+  unsigned int count = readInput();
+  if (count > BROADCAST_TAGS) count = BROADCAST_TAGS;
+  Serial.println(count, DEC);
+  if (base == 0 || count == 0) return;
+
+  Serial.println("Select command:");
+  Serial.println("2 - START tags");
+  Serial.println("4 - STOP tags");
+  Serial.println("6 - WRITE tag settings");
+
+  while (!Serial.available());
+  byte b = Serial.read();
+  if (b == '2') {
+    broadcastTags(CMD_START, base, count, 0, 0);
+  } else if (b == '4') {
+    broadcastTags(CMD_STOP, base, count, 0, 0);
+  } else if (b == '6') {
+    broadcastBase = base;
+    broadcastCount = count;
+    showSettingsMenu();
+    broadcastCount = 0;
+  } else {
+    Serial.println("Unknown command.");
+  }
+}
+
 unsigned int waitForAnyTag() {
   Serial.println("Waiting for tag...");
   radio.setChannel(READER_CHANNEL);
@@ -301,13 +823,22 @@ unsigned int waitForAnyTag() {
 }
 
 unsigned int sendCommandForTag(byte command, unsigned int tagId) {
-  byte packet[3];
+  return sendCommandForTag(command, tagId, 0, 0);
+}
+
+unsigned int sendCommandForTag(byte command, unsigned int tagId, byte *data, int dataLen) {
+  byte packet[32];
   packet[0] = command;
   packet[1] = tagId >> 8;
   packet[2] = tagId & 0xFF;
 
+  for (int i=3; i < (dataLen+3) && i < sizeof(packet); i++) {
+    packet[i] = data[i - 3];
+  }
+
   radio.setAutoAck(true);
-  radioWrite(packet, sizeof(packet));
+  radioWrite(packet, dataLen + 3);
+  return tagId;
 }
 
 
@@ -357,6 +888,10 @@ boolean downloadTagSettings() {
         Serial.println(metaData.readerPeriodSecs);
         Serial.print("sessionTimeoutSecs: ");
         Serial.println(metaData.sessionTimeoutSecs);
+        Serial.print("overflowPolicy: ");
+        Serial.println(overflowPolicies[metaData.overflowPolicy % 3]);
+        Serial.print("Dropped records: ");
+        Serial.println(toULong(inbuf[15], inbuf[16], inbuf[17], inbuf[18]), DEC);
 
         byte batteryLevel = inbuf[1]; // second byte is battery level
         Serial.print("Battery level: ");
@@ -411,7 +946,7 @@ void runDiagnostics() {
 
   timer = millis();
   while (millis() - timer < 10000) {
-    if (downloadTagData(tagid, false, false)) break;
+    if (downloadTagData(tagid, false, false, 0, 0)) break;
     delay(20);
   }
   Serial.println("Done.");
@@ -430,6 +965,10 @@ void printMenu() {
   Serial.println("5 - NOISE scan");
   Serial.println("6 - WRITE tag settings");
   Serial.println("7 - RANGE tester");
+  Serial.println("8 - DOWNLOAD tag data since record");
+  Serial.println("9 - SWEEP new tag data, tag keeps running");
+  Serial.println("b - BROADCAST to a range of tags");
+  Serial.println("i - INVENTORY tags in range, queue them for auto-download");
 }
 
 void handleUserInput() {
@@ -441,10 +980,12 @@ void handleUserInput() {
     
     if (b == '+') {
       autoDownload = true;
+      startRound();
       ledBlinkPeriod = 250;
       Serial.println("Auto-download enabled");
     } else if (b == '-') {
       autoDownload = false;
+      printRound();
       ledBlinkPeriod = 1000;
       Serial.println("Auto-download disabled");
     } else if (b == '1') {
@@ -464,7 +1005,8 @@ void handleUserInput() {
         }
       }
     } else if (b == '3') {
-      downloadTagData(0, true, true);
+      // the whole log, '8' and '9' download part of it
+      downloadTagData(0, true, true, 0, 0);
     } else if (b == '4') {
       unsigned int tag_id = sendCommand(CMD_STOP);      
       delay(20); // give time for response     
@@ -478,6 +1020,17 @@ void handleUserInput() {
       showSettingsMenu();
     } else if (b == '7') {
       rangeTester();
+    } else if (b == '8') {
+      Serial.print("Since record: ");
+      unsigned long since = readInput();
+      Serial.println(since, DEC);
+      downloadTagData(0, true, false, DL_OPT_SINCE, since);
+    } else if (b == '9') {
+      downloadTagData(0, false, false);
+    } else if (b == 'b' || b == 'B') {
+      broadcastMenu();
+    } else if (b == 'i' || b == 'I') {
+      inventory();
     } else if (b == 'x' || b == 'X') {
       // ignore this, it is the "escape" key
     } else {
@@ -490,6 +1043,15 @@ void handleUserInput() {
   }
 }
 
+// Write a setting to one tag, or to the tags of a broadcast
+void sendSetting(byte *data, int dataLen) {
+  if (broadcastCount > 0) {
+    broadcastTags(CMD_WRITE_SETTING, broadcastBase, broadcastCount, data, dataLen);
+  } else {
+    sendCommand(CMD_WRITE_SETTING, data, dataLen);
+  }
+}
+
 void showSettingsMenu() {
   Serial.println("Select setting:");
   Serial.println("1 - Transmit range for tag");
@@ -497,6 +1059,7 @@ void showSettingsMenu() {
   Serial.println("3 - Set listen period");
   Serial.println("4 - Set session timeout");
   Serial.println("5 - RESET settings to tag defaults");
+  Serial.println("6 - Set overflow policy");
 
   while (!Serial.available());
   byte b = Serial.read() - '0';
@@ -520,7 +1083,7 @@ void showSettingsMenu() {
       // received signal must be STRONG (high-bit set to 1) or not
       int range = (b > 3 ? (b - 4) | 0b10000000 : b);
       byte data[] = { SET_PING_TX_RANGE, range };
-      sendCommand(CMD_WRITE_SETTING, data, sizeof(data));
+      sendSetting(data, sizeof(data));
     }
   } else if (b == 2) {
     Serial.print("Listen period (milli seconds): ");
@@ -528,7 +1091,7 @@ void showSettingsMenu() {
     Serial.println(timeout);
     if (timeout > 0) {
       byte data[] = { SET_PING_PERIOD_MS, timeout >> 8, timeout & 0xff };
-      sendCommand(CMD_WRITE_SETTING, data, sizeof(data));
+      sendSetting(data, sizeof(data));
     }
   } else if (b == 2) {
     Serial.print("Listen period (seconds): ");
@@ -536,7 +1099,7 @@ void showSettingsMenu() {
     Serial.println(timeout);
     if (timeout > 0) {
       byte data[] = { SET_LISTEN_PERIOD_S, timeout >> 8, timeout & 0xff };
-      sendCommand(CMD_WRITE_SETTING, data, sizeof(data));
+      sendSetting(data, sizeof(data));
     }
   } else if (b == 3) {
     Serial.print("Listen period (seconds): ");
@@ -544,7 +1107,7 @@ void showSettingsMenu() {
     Serial.println(timeout);
     if (timeout > 0) {
       byte data[] = { SET_LISTEN_PERIOD_S, timeout >> 8, timeout & 0xff };
-      sendCommand(CMD_WRITE_SETTING, data, sizeof(data));
+      sendSetting(data, sizeof(data));
     }
   } else if (b == 4) {
     Serial.print("Session timeout (seconds): ");
@@ -552,16 +1115,37 @@ void showSettingsMenu() {
     Serial.println(timeout);
     if (timeout > 0) {
       byte data[] = { SET_SESSION_TIMEOUT_S, timeout >> 8, timeout & 0xff };
-      sendCommand(CMD_WRITE_SETTING, data, sizeof(data));
+      sendSetting(data, sizeof(data));
     }
   } else if (b == 5) {
     byte data[] = { SET_DEFAULTS };
-    sendCommand(CMD_WRITE_SETTING, data, sizeof(data));
+    sendSetting(data, sizeof(data));
+  } else if (b == 6) {
+    Serial.println("Select overflow policy: ");
+    for (int i=0; i < 3; i++) {
+      Serial.print(i);
+      Serial.print(" - ");
+      Serial.println(overflowPolicies[i]);
+    }
+
+    while (!Serial.available());
+    b = Serial.read() - '0';
+    Serial.println(b);
+
+    if (b > OVERFLOW_STOP) {
+      Serial.print("\nInvalid policy, aborting ");
+      Serial.println(b);
+      return;
+    }
+    byte data[] = { SET_OVERFLOW_POLICY, b };
+    sendSetting(data, sizeof(data));
   } else {
     Serial.println("Function not implemented yet, sorry.");
     return;
   }
 
+  if (broadcastCount > 0) return; // broadcastTags() listed the acks
+
   inbufLen = radioRead();
   if (inbufLen > 0 && inbuf[0] == CMD_ACK) {
     Serial.println("Done.");
@@ -21,6 +21,26 @@ byte inbuf[32];
 byte inbufLen = 0;
 
 boolean autoDownload = false;
+boolean fastLink = false; // radio is on the download profile
+unsigned int broadcastBase = 0; // settings go to the tags of a broadcast
+unsigned int broadcastCount = 0; // if not 0
+
+// tags auto-download waits for, filled in by an inventory. Any tag while
+// it is empty.
+unsigned int downloadQueue[DOWNLOAD_QUEUE_SIZE];
+byte queued = 0;
+boolean queueOnly = false; // filled by an inventory, download only its tags
+
+unsigned long lastScout = 0; // last busy ping during a download
+
+// tags downloaded in this auto-download round
+unsigned int collected[COLLECTED_TAGS];
+byte collectedCount = 0;
+
+// auto-download round totals
+unsigned long roundStarted = 0;
+unsigned long roundRecords = 0;
+unsigned int roundTags = 0;
 unsigned long ledBlinkPeriod = 1000;
 unsigned long ledTime = 0;
 boolean ledState = false;
@@ -28,16 +48,39 @@ boolean ledState = false;
 const byte ping_packet[] = { CMD_PING, reader_id >> 8, reader_id & 0xFF };
 unsigned long lastPing = 0;
 
-const char* ranges[] = {
+const char* const ranges[] = {
     "20 m", "17 m", "12 m", "6 m", "3 m", "60 cm", "40 cm", "20 cm"
 };
 
+const char* const overflowPolicies[] = {
+    "overwrite oldest", "drop newest", "stop tag"
+};
+
 unsigned int sendCommand(byte command);
 unsigned int sendCommand(byte command, byte *data, int dataLen);
 unsigned int waitForAnyTag();
 boolean processDownloadData(unsigned int tagid) ;
+boolean downloadTagData(unsigned int remoteTagId, boolean stopAfter, boolean resetAfter);
+boolean downloadTagData(unsigned int remoteTagId, boolean stopAfter, boolean resetAfter,
+    byte range, unsigned long since);
 unsigned int sendCommandForTag(byte command, unsigned int tagId);
+unsigned int sendCommandForTag(byte command, unsigned int tagId, byte *data, int dataLen);
+void setFastLink(boolean fast);
+void printRecord(unsigned int tagid, unsigned int remoteTagId,
+    unsigned long first, unsigned long last, unsigned long now);
 void showSettingsMenu();
+void sendSetting(byte *data, int dataLen);
+unsigned int broadcastTags(byte command, unsigned int base, unsigned int count,
+    byte *data, int dataLen);
+void broadcastMenu();
+byte findQueued(unsigned int tagid);
+boolean queueTag(unsigned int tagid);
+boolean dequeueTag(unsigned int tagid);
+unsigned int inventory();
+boolean wantTag(unsigned int tagid);
+void scoutForTags(unsigned long busyMs);
+void startRound();
+void printRound();
 void printMenu();
 void sendReaderPing();
 void listenForTags();
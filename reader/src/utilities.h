@@ -12,12 +12,32 @@ unsigned long toULong(byte a, byte b, byte c, byte d) {
   return ret;
 }
 
+// print a rate given in tenths with one decimal, without the float library
+void printTenths(unsigned long tenths) {
+  Serial.print(tenths / 10, DEC);
+  Serial.print(".");
+  Serial.print(tenths % 10, DEC);
+}
+
 // extract the tagid from the ping packet sent by remote
 unsigned int getRemoteTagId(byte* inbuf) {
   return (inbuf[1] << 8) + inbuf[2];
 }
 
-unsigned int readInput() {
+// read a varint of a PKT_PACKED at buf[*j], moving j past it
+unsigned long getVarint(byte *buf, byte *j) {
+  unsigned long v = 0;
+  byte shift = 0;
+  while (*j < 32) {
+    byte b = buf[(*j)++];
+    v |= (unsigned long)(b & 0x7F) << shift;
+    if (!(b & 0x80)) break;
+    shift += 7;
+  }
+  return v;
+}
+
+unsigned long readInput() {
     unsigned long timer = millis();
     unsigned long timer2 = millis();
     boolean on = false;
@@ -51,7 +71,7 @@ unsigned int readInput() {
     int intLength = intData.length() + 1;
     intData.toCharArray(intBuffer, intLength);
 
-    // Convert ASCII-encoded integer to an int
-    unsigned int tagid = atoi(intBuffer);
+    // Convert ASCII-encoded integer to a long, record numbers need it
+    unsigned long tagid = atol(intBuffer);
     return tagid;
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Time the tag main loop is awake per hour, running and stopped, with
+// nothing else in range. Builds main.cpp as is, every millis() call is
+// charged 20 us.
+
+#include "emu.h"
+#include "protocol.h"
+
+void setup();
+void loop();
+extern Protocol protocol;
+
+static void hour(boolean running) {
+  emuEepromErase();
+  emuRadioReset();
+  emuCallUs = 20;
+  emuEeprom[0] = 7; // tag 7, formatted
+  emuEeprom[1] = 0;
+  emuEeprom[2] = CHECK_BYTE1;
+  emuEeprom[3] = CHECK_BYTE2;
+
+  setup();
+  protocol.isStopped = !running;
+  unsigned long long start = emuUs;
+  unsigned long long slept = emuSleptUs;
+  unsigned long passes = 0;
+  while (emuUs - start < 3600ULL * 1000000ULL) {
+    loop();
+    passes++;
+  }
+  printf("  %s: awake %.1f s per hour, %lu loop passes\n", running ? "running" : "stopped",
+      (double)((emuUs - start) - (emuSleptUs - slept)) / 1e6, passes);
+}
+
+int main() {
+  printf("bench_awake:\n");
+  hour(true);
+  hour(false);
+  return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// MSP430 cycles of a seconds() call, millis() / 1000 against
+// SecondsClock, after the millis() call both make. The MSP430G2553 has
+// no hardware divider. The division runs libgcc's shift-and-subtract
+// udivmodsi4 (__mspabi_divul), the loop is run here to count its
+// iterations. Cycles per step are counted by hand from the instruction
+// sequences below, with the MSP430 cycle table (register 1, immediate 2,
+// absolute source 3, absolute destination 4 or 5, jump 2, call 5, ret 3).
+//
+// millis() / 1000:
+//   mov #1000, r14 / clr r15 / call #__mspabi_divul, and in the callee
+//   pushes, pops and ret                                   40 cycles
+//   per shift of the divisor: 32-bit compare with the
+//   dividend, bit != 0, top bit clear, rla/rlc both        16 cycles
+//   per quotient bit: bit != 0, 32-bit compare, sub/subc
+//   and bis when it fits, clrc/rrc/rrc both, jmp           20 cycles
+//
+// SecondsClock::seconds():
+//   load secStartMs, 32-bit subtract, compare with 1000,
+//   load secs, ret                                         26 cycles
+//   per second caught up: add #1000 and adc to secStartMs,
+//   inc and adc to secs, jmp                               19 cycles
+
+#include "tag.h"
+
+#define DIV_CALL_CYCLES   40
+#define DIV_SHIFT_CYCLES  16
+#define DIV_BIT_CYCLES    20
+#define SECS_CALL_CYCLES  26
+#define SECS_STEP_CYCLES  19
+
+// cycles of num / den the way udivmodsi4 does it
+static unsigned long divCycles(uint32_t num, uint32_t den) {
+  uint32_t bit = 1;
+  unsigned long cycles = DIV_CALL_CYCLES;
+
+  while (den < num && bit && !(den & 0x80000000UL)) {
+    den <<= 1;
+    bit <<= 1;
+    cycles += DIV_SHIFT_CYCLES;
+  }
+  while (bit) {
+    if (num >= den) num -= den;
+    bit >>= 1;
+    den >>= 1;
+    cycles += DIV_BIT_CYCLES;
+  }
+  return cycles;
+}
+
+// average over calls every stepMs, from uptime on for an hour. The
+// clock only runs forward, so uptimes must increase from call to call.
+static void uptime(const char *name, unsigned long long uptimeMs, unsigned long stepMs) {
+  unsigned long calls = 0;
+  unsigned long long oldCycles = 0;
+  unsigned long long newCycles = 0;
+
+  emuUs = uptimeMs * 1000;
+  unsigned long secs = SecondsClock::seconds(); // catch up, not counted
+  for (unsigned long ms = 0; ms < 3600000UL; ms += stepMs, calls++) {
+    emuAdvance(stepMs);
+    oldCycles += divCycles(millis(), 1000);
+    unsigned long now = SecondsClock::seconds();
+    newCycles += SECS_CALL_CYCLES + (now - secs) * SECS_STEP_CYCLES;
+    secs = now;
+  }
+
+  printf("  %-7s every %4lu ms: millis()/1000 %4llu cycles, seconds() %3llu cycles\n",
+      name, stepMs, oldCycles / calls, newCycles / calls);
+}
+
+int main() {
+  emuCallUs = 0;
+  printf("bench_clock: MSP430 cycles per call, after millis()\n");
+  uptime("1 min", 60000ULL, 10);
+  uptime("2 h", 7200000ULL, 10);
+  uptime("12 h", 43200000ULL, 10);
+  uptime("24 h", 86400000ULL, 1000);
+  return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Download time of a full log in each format, against the reader model
+// of link.cpp: radio bound, and with the reader printing at 9600 baud,
+// on a clean and lossy links. Then the bytes per record of a crowd trace,
+// where packing pays off.
+
+#include <math.h>
+#include "tag.h"
+#include "link.h"
+
+static const byte formats[] = {
+  0,
+  DL_OPT_BULK,
+  DL_OPT_BULK | DL_OPT_FAST,
+  DL_OPT_BULK | DL_OPT_FAST | DL_OPT_PACK
+};
+static const char *names[] = { "legacy", "bulk", "fast", "packed" };
+
+static void run(Protocol *p, byte options, double loss, double lineMs) {
+  byte in[] = { CMD_DOWNLOAD, (byte)(p->tagid >> 8), (byte)p->tagid,
+      (byte)(options | DL_OPT_RUN) };
+
+  srand(1);
+  linkBegin(loss, lineMs);
+  unsigned long long t = emuUs;
+  p->process(in, sizeof(in));
+  linkFinish();
+  double secs = (emuUs - t) / 1e6;
+
+  printf("  %-7s loss %.1f line %2.0f ms: %5lu of %5lu records in %6.2f s, %5.0f rec/s, "
+      "%5.2f B/rec, %.3f packets/rec, first packet %4lu ms%s\n",
+      names[options == 0 ? 0 : options == DL_OPT_BULK ? 1 : (options & DL_OPT_PACK) ? 3 : 2],
+      loss, lineMs, (unsigned long)reader.records.size(), reader.expected, secs,
+      reader.received / secs, (double)reader.dataBytes / reader.received,
+      (double)reader.dataPackets / reader.received, reader.firstUs / 1000,
+      reader.gaveUp ? ", reader gave up" : "");
+}
+
+// 300 peers with Zipf popularity, seen in bursts
+static void crowd(Protocol *p, unsigned int visits) {
+  double weight[300];
+  double total = 0;
+
+  srand(1);
+  for (int k = 0; k < 300; k++) total += weight[k] = 1.0 / pow(k + 1, 1.1);
+  for (unsigned int k = 0; k < visits; k++) {
+    emuAdvance(7000);
+    double u = rand() / (RAND_MAX + 1.0) * total;
+    int peer = 0;
+    while (u > weight[peer]) u -= weight[peer++];
+    int burst = 1 + (int)(-log(1 - rand() / (RAND_MAX + 1.0)) * 3);
+    for (int b = 0; b < burst; b++) {
+      tagPing(p, 1000 + peer * 37);
+      emuAdvance(2000);
+    }
+    p->tick();
+  }
+  tagSettle(p);
+}
+
+int main() {
+  Protocol p;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  p.metaData.overflowPolicy = OVERFLOW_DROP;
+  tagVisits(&p, 6000, 3000);
+  tagSettle(&p);
+  printf("bench_link: full log of %lu records, 40 peers\n", p.logMeta.records);
+  for (byte f = 0; f < sizeof(formats); f++) {
+    run(&p, formats[f], 0, 0);
+    run(&p, formats[f], 0.3, 0);
+    run(&p, formats[f], 0.1, 26);
+  }
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  crowd(&p, 1500);
+  printf("bench_link: crowd trace of %lu records, 300 peers\n", p.logMeta.records);
+  for (byte f = 0; f < sizeof(formats); f++) {
+    run(&p, formats[f], 0, 0);
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Dense crowd: more peers in range than RAM sessions, each seen with a
+// given chance every 2 s for 300 loops. No contact is lost, but a
+// spilled session is only resumed while it is in the spill index or the
+// block being filled. Beyond a few peers over MAX_RAM_SESSIONS most are
+// not, and every spill leaves a record: records and writes grow fast.
+
+#include <map>
+#include "tag.h"
+
+static void crowd(unsigned int peers, int percent) {
+  Protocol p;
+  std::map<unsigned int, unsigned long> records;
+  unsigned long pings = 0;
+  unsigned long lost = 0;
+  unsigned long total = 0;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  srand(2);
+  for (int k = 0; k < 300; k++) {
+    emuAdvance(2000);
+    for (unsigned int peer = 1; peer <= peers; peer++) {
+      if (rand() % 100 < percent) {
+        pings++;
+        tagPing(&p, peer);
+        if (p.sessions.find(peer) == NULL) lost++;
+      }
+    }
+    p.tick();
+  }
+  tagSettle(&p);
+
+  UploadCursor c = UploadCursor();
+  TagData d;
+  while (HostTest::nextRecord(&p, &c, &d)) {
+    records[d.tagid]++;
+    total++;
+  }
+  printf("%3u peers %3d%%: %6lu pings, %4lu lost, %3zu peers recorded as %5lu records, %lu writes\n",
+      peers, percent, pings, lost, records.size(), total, emuWriteCycles);
+}
+
+int main() {
+  printf("bench_spill: %d RAM sessions, %d staged, %d spills indexed\n",
+      MAX_RAM_SESSIONS, STAGED_SESSIONS, SPILL_INDEX);
+  crowd(16, 50);
+  crowd(20, 50);
+  crowd(24, 50);
+  crowd(32, 50);
+  crowd(40, 30);
+  return 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// EEPROM cost of the log: SPI transactions and write cycles per record,
+// a reset and a boot, and sessions held against the baseline format. The
+// log structs are fixed width, so records per block are the tag's.
+
+#include "tag.h"
+
+static void part(const char *name, int addrBytes, unsigned long size, unsigned long pageSize) {
+  Protocol p;
+
+  tagFormat(addrBytes, size, pageSize);
+  tagStart(&p, 5);
+  unsigned long cycles = emuWriteCycles;
+  unsigned long page0 = emuPage0Writes;
+  tagVisits(&p, 5000, 3000);
+  tagSettle(&p);
+  unsigned long records = p.logMeta.records;
+  double writes = (double)(emuWriteCycles - cycles) / records;
+  page0 = emuPage0Writes - page0;
+
+  // read every record, as an upload does
+  unsigned long tx = eeprom.transactions;
+  unsigned long long t = emuUs;
+  UploadCursor c = UploadCursor();
+  TagData d;
+  while (HostTest::nextRecord(&p, &c, &d));
+  double scanTx = (double)(eeprom.transactions - tx) / records;
+  double scanUs = (double)(emuUs - t) / records;
+
+  tx = eeprom.transactions;
+  t = emuUs;
+  Protocol q;
+  q.begin(5, &radio, &eeprom);
+  unsigned long bootTx = eeprom.transactions - tx;
+  unsigned long bootMs = (emuUs - t) / 1000;
+
+  tx = eeprom.transactions;
+  q.resetData();
+  unsigned long resetTx = eeprom.transactions - tx;
+
+  printf("%-9s writes/record %.2f, page 0 %lu, scan %.2f tx %.0f us/record, boot %lu tx %lu ms, reset %lu tx\n",
+      name, writes, page0, scanTx, scanUs, bootTx, bootMs, resetTx);
+}
+
+// The baseline stored each session as a TagData of tagid(2), first(4),
+// last(4) and a check byte, 12 bytes on the MSP430, from the end of the
+// MetaData (14 bytes) to the end of the EEPROM.
+#define OLD_TAGDATA_SIZE  12
+#define OLD_METADATA_SIZE 14
+
+// sessions a 25LC512 holds in either format, on the same trace: one
+// record per visit, until the log drops one. Sessions time out after
+// 30 s, so the log fills before the tag auto-stops.
+static void capacity() {
+  Protocol p;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  p.metaData.sessionTimeoutSecs = 30;
+  while (p.logMeta.dropped == 0 && !p.isStopped) {
+    tagVisits(&p, 100, 1000);
+    p.flushStaged();
+  }
+  unsigned long old = (0x10000UL - EEPROM_DATA_START - OLD_METADATA_SIZE) / OLD_TAGDATA_SIZE;
+  unsigned long records = p.logMeta.records;
+
+  printf("25LC512   sessions: %lu as TagData, %lu in the log, %.2fx\n",
+      old, records, (double)records / old);
+}
+
+int main() {
+  printf("bench_storage: %d byte records, %d per block\n", (int)sizeof(LogRecord), (int)RECORDS_PER_BLOCK);
+  part("25LC512", 2, 0x10000UL, 128);
+  part("25LC1024", 3, 0x20000UL, 256);
+  part("2 Mbit", 3, 0x40000UL, 256);
+  capacity();
+  return 0;
+}
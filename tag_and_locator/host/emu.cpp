@@ -0,0 +1,163 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Host emulation of the Energia core, the SPI EEPROM and the radio
+// hooks declared in the stub headers.
+
+#include "emu.h"
+#include "SPI.h"
+#include "eeprom.h"
+
+HardwareSerial Serial;
+SPIClass SPI;
+
+unsigned long long emuUs = 0;
+unsigned long long emuSleptUs = 0;
+unsigned long emuCallUs = 10;
+
+void emuAdvance(unsigned long ms) {
+  emuUs += ms * 1000ULL;
+}
+
+unsigned long millis() {
+  emuUs += emuCallUs;
+  return (unsigned long)(emuUs / 1000);
+}
+
+unsigned long micros() {
+  emuUs += emuCallUs;
+  return (unsigned long)emuUs;
+}
+
+void delay(unsigned long ms) { emuUs += ms * 1000ULL; }
+void delayMicroseconds(unsigned int us) { emuUs += us; }
+
+void sleep(unsigned long ms) {
+  emuUs += ms * 1000ULL;
+  emuSleptUs += ms * 1000ULL;
+}
+
+void sleepSeconds(unsigned long secs) { sleep(secs * 1000); }
+void suspend() {}
+void wakeup() {}
+void pinMode(int, int) {}
+// IRQ lines idle high, the radio's (P2_2) goes low with a packet in
+int digitalRead(int pin) {
+  return pin == P2_2 && rf.listening && rfAvailHook && rfAvailHook() ? LOW : HIGH;
+}
+int analogRead(int) { return 512; }
+void analogReference(int) {}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+long random(long max) { return rand() % max; }
+long random(long min, long max) { return min + rand() % (max - min); }
+void randomSeed(unsigned long seed) { srand(seed); }
+void attachInterrupt(int, void (*)(void), int) {}
+void detachInterrupt(int) {}
+
+// EEPROM
+
+byte emuEeprom[EMU_EEPROM_MAX];
+unsigned long emuEepromSize = 0x10000;
+int emuAddrBytes = 2;
+unsigned long emuPageSize = 128;
+unsigned long emuWriteCycles = 0;
+unsigned long emuPage0Writes = 0;
+unsigned long emuSpiByteUs = 3;
+unsigned long emuWriteUs = 5000;
+
+static boolean selected = false;
+static byte op = 0;
+static int phase = 0; // bytes of the command so far
+static unsigned long address = 0;
+static boolean writeEnabled = false;
+static byte pageBuf[256];
+static unsigned int pageLen = 0;
+static unsigned long long busyUntil = 0; // write cycle in progress
+
+void emuEepromErase() {
+  memset(emuEeprom, 0xFF, sizeof(emuEeprom));
+}
+
+// chip select, a WRITE is committed when it goes high
+void digitalWrite(int pin, int value) {
+  if (pin != EEPROM_CS) return;
+
+  if (value == LOW) {
+    selected = true;
+    phase = 0;
+    address = 0;
+    pageLen = 0;
+  } else if (selected) {
+    if (op == SPIEEP_WRITE && phase > emuAddrBytes && writeEnabled) {
+      // wraps around within the page, like the part
+      for (unsigned int k = 0; k < pageLen; k++) {
+        unsigned long a = (address & ~(emuPageSize - 1)) |
+            ((address + k) & (emuPageSize - 1));
+        emuEeprom[a % emuEepromSize] = pageBuf[k];
+      }
+      writeEnabled = false;
+      emuWriteCycles++;
+      if ((address % emuEepromSize) < EEPROM_PAGE_SIZE) emuPage0Writes++;
+      busyUntil = emuUs + emuWriteUs;
+    }
+    selected = false;
+  }
+}
+
+byte SPIClass::transfer(byte b) {
+  if (!selected) return 0xFF;
+  emuUs += emuSpiByteUs;
+
+  if (phase == 0) {
+    op = b;
+    phase = 1;
+    if (op == SPIEEP_WREN) writeEnabled = true;
+    if (op == SPIEEP_WRDI) writeEnabled = false;
+    return 0;
+  }
+
+  switch (op) {
+    case SPIEEP_RDSR:
+      return (writeEnabled ? (1 << SPIEEP_STATUS_WEL) : 0) |
+          (emuUs < busyUntil ? (1 << SPIEEP_STATUS_WIP) : 0);
+    case SPIEEP_RDID:
+      // 3 address bytes, then the signature
+      return ++phase > 4 ? 0x29 : 0;
+    case SPIEEP_READ:
+    case SPIEEP_WRITE:
+      if (phase <= emuAddrBytes) {
+        address = (address << 8) | b;
+        phase++;
+        return 0;
+      }
+      if (op == SPIEEP_READ) {
+        return emuEeprom[address++ % emuEepromSize];
+      }
+      if (pageLen < sizeof(pageBuf)) pageBuf[pageLen++] = b;
+      return 0;
+  }
+  return 0;
+}
+
+// radio
+
+bool (*rfSendHook)(const void *, uint8_t) = 0;
+bool (*rfAvailHook)() = 0;
+void (*rfReadHook)(void *, uint8_t) = 0;
+bool (*rfRpdHook)() = 0;
+RfState rf;
+
+void emuRadioReset() {
+  rfSendHook = 0;
+  rfAvailHook = 0;
+  rfReadHook = 0;
+  rfRpdHook = 0;
+  memset(&rf, 0, sizeof(rf));
+  rf.retryDelay = 5;
+  rf.retryCount = 15;
+}
@@ -0,0 +1,34 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+#ifndef _RFT_HOST_EMU_H
+#define _RFT_HOST_EMU_H
+
+#include "Arduino.h"
+#include "RF24.h"
+
+// Emulated time in microseconds. delay() and sleep() move it on, and
+// every millis()/micros() call takes emuCallUs so busy loops end.
+extern unsigned long long emuUs;
+extern unsigned long long emuSleptUs; // of which spent in sleep()
+extern unsigned long emuCallUs;
+void emuAdvance(unsigned long ms);
+
+// 25LC512-style SPI EEPROM: READ, WRITE within a page, WREN/WRDI, RDSR
+// and RDID. Larger parts take 3 address bytes.
+#define EMU_EEPROM_MAX (1UL << 18)
+extern byte emuEeprom[EMU_EEPROM_MAX];
+extern unsigned long emuEepromSize;
+extern int emuAddrBytes;
+extern unsigned long emuPageSize;
+extern unsigned long emuWriteCycles; // page writes
+extern unsigned long emuPage0Writes; // of which to the tag id and settings page
+extern unsigned long emuSpiByteUs; // SPI.transfer() on the tag, 8 MHz
+extern unsigned long emuWriteUs; // write cycle, WIP is set meanwhile
+void emuEepromErase(); // to 0xFF, as shipped
+
+// radio settings back to power-on, and no hooks
+void emuRadioReset();
+
+#endif
@@ -0,0 +1,261 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+#include <deque>
+#include "link.h"
+#include "global.h"
+
+LinkReader reader;
+
+struct AirPacket {
+  byte b[32];
+  unsigned long long at; // arrival time
+};
+
+static std::deque<AirPacket> fifo; // reader receive FIFO
+static std::deque<AirPacket> toTag; // acks on their way to the tag
+static unsigned long long started; // download command sent
+static unsigned long long readerFree; // reader done with the last packet
+static unsigned long long lastPacket;
+static boolean anyPacket;
+static unsigned int windowBase;
+static byte windowBits;
+static unsigned int dict[PACK_DICT_SIZE];
+static boolean dictReady;
+
+static boolean lost() {
+  return rand() < reader.loss * ((double)RAND_MAX + 1);
+}
+
+static unsigned long readUL(const byte *p) {
+  return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+      ((unsigned long)p[2] << 8) | p[3];
+}
+
+static unsigned long readVarint(const byte *b, byte *j) {
+  unsigned long v = 0;
+  byte shift = 0;
+  while (*j < 32) {
+    byte c = b[(*j)++];
+    v |= (unsigned long)(c & 0x7F) << shift;
+    if (!(c & 0x80)) break;
+    shift += 7;
+  }
+  return v;
+}
+
+// time on air of a packet at the tag's current rate
+static unsigned long airUs(byte payload) {
+  return 130 + (9 + payload) * 8 / (rf.rate == RF24_2MBPS ? 2 : 1);
+}
+
+static void record(unsigned int remote, unsigned long first, unsigned int duration) {
+  reader.received++;
+  reader.checksum += remote + duration;
+  reader.records.insert(std::make_pair(remote, first));
+}
+
+// a record takes lineMs to print, the SPI read of a packet 300us
+static unsigned long receive(AirPacket *k) {
+  byte *in = k->b;
+  unsigned long cost = 300;
+
+  if (in[0] == CMD_ACK) {
+    reader.done = true;
+  } else if (in[0] == PKT_INDEX) {
+    reader.indexed = true;
+    reader.expected = readUL(&in[1]);
+    reader.expectedChecksum = ((unsigned int)in[13] << 8) | in[14];
+    if (in[15] & DL_OPT_FAST) reader.fast = true;
+    cost += (unsigned long)(reader.lineMs * 2000); // two lines
+  } else if (in[0] == PKT_DATA) {
+    unsigned long first = readUL(&in[3]);
+    record(((unsigned int)in[1] << 8) | in[2], first, readUL(&in[7]) - first);
+    cost += (unsigned long)(reader.lineMs * 1000);
+    if (reader.indexed && reader.received == reader.expected) reader.done = true;
+  } else if (in[0] == PKT_BULK || in[0] == PKT_PACKED || in[0] == PKT_DICT) {
+    if (in[0] == PKT_PACKED && !dictReady) return cost;
+    unsigned int seq = ((unsigned int)in[1] << 8) | in[2];
+    int offset = (int)(seq - windowBase);
+    if ((short)offset < 0) {
+      reader.dupes++;
+      return cost;
+    }
+    if (offset >= BULK_WINDOW) {
+      windowBase = seq & ~(BULK_WINDOW - 1);
+      windowBits = 0;
+      offset = seq - windowBase;
+    }
+    if (windowBits & (1 << offset)) {
+      reader.dupes++;
+      return cost;
+    }
+    windowBits |= 1 << offset;
+
+    if (in[0] == PKT_DICT) {
+      for (byte k = 0; k < PACK_DICT_SIZE; k++) {
+        dict[k] = ((unsigned int)in[BULK_HEADER_LEN + 2 * k] << 8) |
+            in[BULK_HEADER_LEN + 2 * k + 1];
+      }
+      dictReady = true;
+      return cost;
+    }
+
+    byte j = BULK_HEADER_LEN;
+    unsigned long first = 0;
+    for (byte n = 0; n < in[3]; n++) {
+      unsigned int remote;
+      unsigned int duration;
+      if (in[0] == PKT_BULK) {
+        remote = ((unsigned int)in[j] << 8) | in[j + 1];
+        first = readUL(&in[j + 2]);
+        duration = ((unsigned int)in[j + 6] << 8) | in[j + 7];
+        j += BULK_RECORD_LEN;
+      } else {
+        if (in[j] == PACK_LITERAL) {
+          remote = ((unsigned int)in[j + 1] << 8) | in[j + 2];
+          j += 3;
+        } else {
+          remote = dict[in[j++] % PACK_DICT_SIZE];
+        }
+        unsigned long delta = readVarint(in, &j);
+        first += (delta >> 1) ^ (0UL - (delta & 1));
+        duration = readVarint(in, &j);
+      }
+      record(remote, first, duration);
+      cost += (unsigned long)(reader.lineMs * 1000);
+    }
+  } else if (in[0] == PKT_WINDOW) {
+    unsigned int base = ((unsigned int)in[3] << 8) | in[4];
+    if (base != windowBase) {
+      windowBase = base;
+      windowBits = 0;
+    }
+
+    // the ack goes out with hardware retries
+    byte ackLen = reader.fast ? 6 : 32;
+    unsigned long long t = readerFree + cost;
+    for (int a = 0; a <= rf.retryCount; a++) {
+      reader.airPackets++;
+      if (!lost()) {
+        AirPacket r;
+        memcpy(r.b, in, 5);
+        r.b[0] = CMD_WINDOW_ACK;
+        r.b[5] = windowBits;
+        r.at = t + airUs(ackLen);
+        toTag.push_back(r);
+        break;
+      }
+      t += airUs(ackLen) + (rf.retryDelay + 1) * 250;
+    }
+    cost = (unsigned long)(t - readerFree) + airUs(ackLen) + airUs(0);
+    if (reader.indexed && reader.received == reader.expected) reader.done = true;
+  }
+  return cost;
+}
+
+// the reader takes the packets that arrived by time t
+static void advance(unsigned long long t) {
+  while (!fifo.empty()) {
+    unsigned long long at = readerFree > fifo.front().at ? readerFree : fifo.front().at;
+    if (at > t) break;
+    if (reader.done || reader.gaveUp) {
+      fifo.clear();
+      break;
+    }
+
+    // processDownloadData() timeouts
+    if (!anyPacket && at - started > 3000000ULL) reader.gaveUp = true;
+    if (anyPacket && at - lastPacket > 250000ULL) reader.gaveUp = true;
+    if (reader.gaveUp) continue;
+
+    if (!anyPacket) reader.firstUs = at - started;
+    if (anyPacket && at - lastPacket > reader.maxGapUs) reader.maxGapUs = at - lastPacket;
+    anyPacket = true;
+    lastPacket = at;
+
+    AirPacket k = fifo.front();
+    fifo.pop_front();
+    readerFree = at + receive(&k);
+  }
+}
+
+static boolean listening() {
+  return !reader.done && !reader.gaveUp && (reader.cutUs == 0 || emuUs < reader.cutUs);
+}
+
+// a write with hardware retries, acked once it is in the reader FIFO
+static bool send(const void *buf, uint8_t len) {
+  unsigned long air = airUs(rf.dynamicPayloads ? len : 32);
+  const byte *b = (const byte *)buf;
+
+  for (int a = 0; a <= rf.retryCount; a++) {
+    advance(emuUs);
+    reader.airPackets++;
+    boolean sameRate = reader.fast == (rf.rate == RF24_2MBPS);
+    if (b[0] == PKT_INDEX && reader.indexLosses > 0) {
+      reader.indexLosses--;
+    } else if (listening() && sameRate && !lost() && fifo.size() < 3) {
+      AirPacket k;
+      memcpy(k.b, buf, len);
+      memset(k.b + len, 0, 32 - len);
+      k.at = emuUs + air;
+      fifo.push_back(k);
+      if (b[0] == PKT_DATA || b[0] == PKT_BULK || b[0] == PKT_PACKED || b[0] == PKT_DICT) {
+        reader.dataBytes += rf.dynamicPayloads ? len : 32;
+        reader.dataPackets++;
+      }
+      if (b[0] == PKT_INDEX && reader.indexAckLosses > 0) {
+        // in the FIFO, the tag tries again
+        reader.indexAckLosses--;
+        emuUs += air + (rf.retryDelay + 1) * 250;
+        continue;
+      }
+      emuUs += air + airUs(0);
+      return true;
+    }
+    emuUs += air + (rf.retryDelay + 1) * 250;
+  }
+
+  reader.failedWrites++;
+  return false;
+}
+
+static bool available() {
+  advance(emuUs);
+  emuUs += 20;
+  return !toTag.empty() && toTag.front().at <= emuUs;
+}
+
+static void read(void *buf, uint8_t len) {
+  memcpy(buf, toTag.front().b, len);
+  toTag.pop_front();
+}
+
+void linkBegin(double loss, double lineMs) {
+  reader = LinkReader();
+  reader.loss = loss;
+  reader.lineMs = lineMs;
+  fifo.clear();
+  toTag.clear();
+  started = emuUs;
+  readerFree = emuUs;
+  lastPacket = emuUs;
+  anyPacket = false;
+  windowBase = 0;
+  windowBits = 0;
+  dictReady = false;
+
+  rfSendHook = send;
+  rfAvailHook = available;
+  rfReadHook = read;
+}
+
+void linkFinish() {
+  advance(~0ULL);
+}
+
+boolean linkChecksumOk() {
+  return (uint16_t)reader.checksum == reader.expectedChecksum; // 16 bits on the reader
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+#ifndef _RFT_HOST_LINK_H
+#define _RFT_HOST_LINK_H
+
+#include <set>
+#include <utility>
+#include "emu.h"
+
+// The reader side of a download as processDownloadData() in reader.cpp
+// runs it, on a link that loses a share of the packets. The reader takes
+// packets into a 3 deep FIFO and prints every record it gets, which is
+// what paces a bulk upload. Hooked into the radio stub by linkBegin().
+struct LinkReader {
+  // settings
+  double loss; // share of packets and acks lost on air
+  double lineMs; // time to print a record on the serial line
+  unsigned long long cutUs; // reader leaves at this time, 0 = never
+  unsigned int indexLosses; // tries of PKT_INDEX lost on top of the loss
+  unsigned int indexAckLosses; // acks of PKT_INDEX lost
+
+  // what the reader saw
+  boolean indexed;
+  boolean fast; // on the download profile after the index
+  boolean done; // got everything, or the final ack
+  boolean gaveUp; // timed out waiting for a packet
+  unsigned long expected; // records in the index
+  unsigned int expectedChecksum;
+  unsigned long received; // records printed, duplicates included
+  unsigned int checksum;
+  unsigned long dupes; // packets sent again after they arrived
+  unsigned long firstUs; // from the download command to the first packet
+  unsigned long maxGapUs; // longest wait between packets
+  std::set<std::pair<unsigned int, unsigned long> > records; // tag, first seen
+
+  // the air, as seen from the tag
+  unsigned long airPackets; // tries, acked or not
+  unsigned long failedWrites; // out of retries
+  unsigned long dataBytes; // payload bytes of acked record packets
+  unsigned long dataPackets;
+};
+
+extern LinkReader reader;
+
+// reset the reader, which sends the download command now
+void linkBegin(double loss, double lineMs);
+
+// let the reader work through its FIFO
+void linkFinish();
+
+boolean linkChecksumOk();
+
+#endif
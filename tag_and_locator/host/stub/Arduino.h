@@ -0,0 +1,84 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Host stand-in for the Energia core: the types, pins and calls the tag
+// firmware uses. Time, pins and the ADC are emulated in emu.cpp.
+
+#ifndef _RFT_HOST_ARDUINO_H
+#define _RFT_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLDOWN 2
+#define INPUT_PULLUP 5
+#define RISING 3
+#define FALLING 4
+#define DEC 10
+#define HEX 16
+#define DEFAULT 0
+#define INTERNAL1V5 1
+
+// MSP430G2553 LaunchPad pins
+#define RED_LED 2
+#define P2_0 8
+#define P2_1 9
+#define P2_2 10
+#define P2_3 11
+#define P2_5 13
+#define A10 10
+#define A11 11
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void sleep(unsigned long ms);
+void sleepSeconds(unsigned long secs);
+void suspend();
+void wakeup();
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+int analogRead(int pin);
+void analogReference(int mode);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+void attachInterrupt(int pin, void (*isr)(void), int mode);
+void detachInterrupt(int pin);
+
+// Energia has min() and max() macros, which break the STL headers the
+// tests use
+using std::min;
+using std::max;
+
+// Serial output is dropped, input is empty
+class HardwareSerial {
+  public:
+    void begin(long) {}
+    template <class T> void print(T) {}
+    template <class T> void print(T, int) {}
+    void println() {}
+    template <class T> void println(T) {}
+    template <class T> void println(T, int) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    void flush() {}
+};
+
+extern HardwareSerial Serial;
+
+#endif
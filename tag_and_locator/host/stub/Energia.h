@@ -0,0 +1,6 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// The firmware includes <Energia.h>, the host core is Arduino.h
+#include "Arduino.h"
@@ -0,0 +1,68 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Host stand-in for the RF24 library. The radio is a set of hooks a test
+// points at its model of the air, and the settings the firmware made.
+// Without hooks, writes succeed and nothing is received.
+
+#ifndef _RFT_HOST_RF24_H
+#define _RFT_HOST_RF24_H
+
+#include "Arduino.h"
+
+typedef enum { RF24_PA_MIN = 0, RF24_PA_LOW, RF24_PA_HIGH, RF24_PA_MAX, RF24_PA_ERROR } rf24_pa_dbm_e;
+typedef enum { RF24_1MBPS = 0, RF24_2MBPS, RF24_250KBPS } rf24_datarate_e;
+typedef enum { RF24_CRC_DISABLED = 0, RF24_CRC_8, RF24_CRC_16 } rf24_crclength_e;
+
+// the air, see emu.cpp
+extern bool (*rfSendHook)(const void *buf, uint8_t len); // false if not acked
+extern bool (*rfAvailHook)();
+extern void (*rfReadHook)(void *buf, uint8_t len);
+extern bool (*rfRpdHook)(); // carrier above -64 dBm since the last read
+
+// radio settings
+struct RfState {
+  int rate; // rf24_datarate_e
+  int channel;
+  int retryDelay;
+  int retryCount;
+  bool dynamicPayloads;
+  bool autoAck;
+  bool listening;
+};
+extern RfState rf;
+
+class RF24 {
+  public:
+    RF24(int, int) {}
+    bool begin() { return true; }
+    bool isChipConnected() { return true; }
+    bool setDataRate(rf24_datarate_e r) { rf.rate = r; return true; }
+    void setChannel(uint8_t c) { rf.channel = c; }
+    uint8_t getChannel() { return rf.channel; }
+    void openWritingPipe(const uint8_t *) {}
+    void openReadingPipe(uint8_t, const uint8_t *) {}
+    void enableDynamicPayloads() { rf.dynamicPayloads = true; }
+    void disableDynamicPayloads() { rf.dynamicPayloads = false; }
+    void setAutoAck(bool on) { rf.autoAck = on; }
+    void setRetries(uint8_t d, uint8_t c) { rf.retryDelay = d; rf.retryCount = c; }
+    void setCRCLength(rf24_crclength_e) {}
+    void setPayloadSize(uint8_t) {}
+    uint8_t getPayloadSize() { return 32; }
+    uint8_t getDynamicPayloadSize() { return 32; }
+    bool available() { return rfAvailHook ? rfAvailHook() : false; }
+    void read(void *buf, uint8_t len) { if (rfReadHook) rfReadHook(buf, len); }
+    bool write(const void *buf, uint8_t len) { return rfSendHook ? rfSendHook(buf, len) : true; }
+    void startListening() { rf.listening = true; }
+    void stopListening() { rf.listening = false; }
+    uint8_t flush_rx() { return 0; }
+    uint8_t flush_tx() { return 0; }
+    bool testRPD() { return rfRpdHook ? rfRpdHook() : false; }
+    void setPALevel(uint8_t, bool lna = true) {}
+    void powerUp() {}
+    void powerDown() {}
+    void maskIRQ(bool, bool, bool) {}
+};
+
+#endif
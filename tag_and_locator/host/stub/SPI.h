@@ -0,0 +1,28 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Host stand-in for the Energia SPI library, wired to the EEPROM
+// emulation in emu.cpp.
+
+#ifndef _RFT_HOST_SPI_H
+#define _RFT_HOST_SPI_H
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0
+#define MSBFIRST 1
+#define SPI_CLOCK_DIV2 2
+
+class SPIClass {
+  public:
+    void begin() {}
+    void setDataMode(int) {}
+    void setBitOrder(int) {}
+    void setClockDivider(int) {}
+    byte transfer(byte b);
+};
+
+extern SPIClass SPI;
+
+#endif
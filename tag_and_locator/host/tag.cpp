@@ -0,0 +1,62 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+#include "tag.h"
+
+RF24 radio(P2_0, P2_1);
+Eeprom eeprom;
+
+void tagFormat(int addrBytes, unsigned long size, unsigned long pageSize) {
+  byte header[] = { 0, 0, CHECK_BYTE1, CHECK_BYTE2 };
+
+  emuEepromErase();
+  emuAddrBytes = addrBytes;
+  emuEepromSize = size;
+  emuPageSize = pageSize;
+  emuRadioReset();
+  eeprom = Eeprom();
+  eeprom.begin();
+  eeprom.format(0, header, sizeof(header));
+}
+
+void tagStart(Protocol *p, unsigned int tagid) {
+  p->begin(tagid, &radio, &eeprom);
+  p->resetData();
+  p->isStopped = false;
+  p->sessionStartSecs = p->seconds();
+}
+
+void tagPing(Protocol *p, unsigned int peer) {
+  byte ping[] = { CMD_PING, (byte)(peer >> 8), (byte)peer, 0 };
+  p->process(ping, sizeof(ping));
+
+  // the main loop polls the EEPROM in between
+  emuAdvance(5);
+  p->pollStorage();
+}
+
+void tagIdle(Protocol *p, unsigned long ms) {
+  for (; ms >= 1000; ms -= 1000) {
+    emuAdvance(1000);
+    p->tick();
+  }
+  emuAdvance(ms);
+  p->tick();
+}
+
+void tagVisits(Protocol *p, unsigned int visits, unsigned long everyMs) {
+  static unsigned int visit = 0;
+
+  for (unsigned int k = 0; k < visits; k++, visit++) {
+    emuAdvance(everyMs);
+    tagPing(p, visit % 40 + 10);
+    p->tick();
+    if (k % 3 == 0) p->pollStorage();
+  }
+}
+
+void tagSettle(Protocol *p) {
+  tagIdle(p, 200000UL);
+  p->flushStaged();
+}
@@ -0,0 +1,52 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+#ifndef _RFT_HOST_TAG_H
+#define _RFT_HOST_TAG_H
+
+#include "emu.h"
+#include "eeprom.h"
+#include "protocol.h"
+
+// Tag on the bench: emulated EEPROM and radio, and helpers to feed it
+// pings the way the main loop does.
+extern RF24 radio;
+extern Eeprom eeprom;
+
+// blank EEPROM of the given geometry, settings written as setup() does
+void tagFormat(int addrBytes, unsigned long size, unsigned long pageSize);
+
+// begin() a tag and start it, with an empty log
+void tagStart(Protocol *p, unsigned int tagid);
+
+// a ping from a peer, as received while listening
+void tagPing(Protocol *p, unsigned int peer);
+
+// let time pass, ticking every second
+void tagIdle(Protocol *p, unsigned long ms);
+
+// visits of one of 40 peers, every 7 seconds by default
+void tagVisits(Protocol *p, unsigned int visits, unsigned long everyMs = 7000);
+
+// let all sessions expire into the log
+void tagSettle(Protocol *p);
+
+// Private members the tests and benchmarks use, a friend of Protocol and
+// SessionTable
+struct HostTest {
+  static boolean nextRecord(Protocol *p, UploadCursor *c, TagData *d) {
+    return p->nextRecord(c, d);
+  }
+
+  static unsigned long recordSeq(Protocol *p, UploadCursor *c) {
+    return p->recordSeq(c);
+  }
+
+  template <class Table>
+  static byte home(unsigned int tagId) {
+    return Table::home(tagId);
+  }
+};
+
+#endif
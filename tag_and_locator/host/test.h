@@ -0,0 +1,34 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+#ifndef _RFT_HOST_TEST_H
+#define _RFT_HOST_TEST_H
+
+#include <stdio.h>
+
+// Checks keep going after a failure, main() returns testResult()
+static int testFailures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      testFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) do { \
+    unsigned long _a = (a), _b = (b); \
+    if (_a != _b) { \
+      printf("%s:%d: CHECK_EQ(%s, %s) failed: %lu != %lu\n", \
+          __FILE__, __LINE__, #a, #b, _a, _b); \
+      testFailures++; \
+    } \
+  } while (0)
+
+static int testResult(const char *name) {
+  printf("%s: %s\n", name, testFailures ? "FAILED" : "ok");
+  return testFailures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Tags ack a broadcast within the time the reader listens after it,
+// then run the command
+
+#include "test.h"
+#include "tag.h"
+
+#define READER_LISTEN_US 15000 // BROADCAST_LISTEN_MS of the reader
+
+static unsigned long long ackUs;
+static byte ackLen;
+
+static bool ack(const void *buf, uint8_t len) {
+  if (((const byte *)buf)[0] == CMD_ACK && ackLen == 0) {
+    ackUs = emuUs;
+    ackLen = len;
+  }
+  return true;
+}
+
+// a broadcast from base 0x100 for this tag, 0x105
+static void broadcast(Protocol *p, byte command, byte setting, unsigned int value) {
+  byte in[BROADCAST_HEADER_LEN + BROADCAST_TAGS / 8];
+  memset(in, 0, sizeof(in));
+  in[0] = CMD_BROADCAST;
+  in[1] = 0x01;
+  in[2] = 0x00;
+  in[3] = command;
+  in[4] = setting;
+  in[5] = value >> 8;
+  in[6] = value;
+  in[BROADCAST_HEADER_LEN] = 1 << 5;
+
+  unsigned long long t = emuUs;
+  ackLen = 0;
+  p->process(in, sizeof(in));
+  CHECK_EQ(ackLen, 3);
+  CHECK(ackUs - t < READER_LISTEN_US);
+}
+
+int main() {
+  Protocol p;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 0x105);
+  rfSendHook = ack;
+  srand(4);
+
+  for (int k = 0; k < 20; k++) {
+    broadcast(&p, CMD_STOP, 0, 0);
+    CHECK(p.isStopped);
+    broadcast(&p, CMD_START, 0, 0);
+    CHECK(!p.isStopped);
+    broadcast(&p, CMD_WRITE_SETTING, SET_PING_PERIOD_MS, 500 + k);
+    CHECK_EQ(p.metaData.pingPeriodMs, 500 + k);
+  }
+
+  // not in the bitmap
+  byte other[BROADCAST_HEADER_LEN + BROADCAST_TAGS / 8];
+  memset(other, 0, sizeof(other));
+  other[0] = CMD_BROADCAST;
+  other[1] = 0x01;
+  other[3] = CMD_STOP;
+  other[BROADCAST_HEADER_LEN] = 1 << 4;
+  ackLen = 0;
+  p.process(other, sizeof(other));
+  CHECK_EQ(ackLen, 0);
+  CHECK(!p.isStopped);
+
+  return testResult("test_broadcast");
+}
@@ -0,0 +1,112 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// A reader busy with another tag turns the tag away until the busy
+// field of its ping, the tag only tells it that it is waiting. Then the
+// tag answers its next ping. Builds main.cpp
+// as is, with a reader pinging every 10 ms on the reader channel.
+
+#include <vector>
+#include "test.h"
+#include "emu.h"
+#include "protocol.h"
+
+void setup();
+void loop();
+extern Protocol protocol;
+
+static byte busy; // of the reader pings
+static unsigned long long lastPing;
+static std::vector<unsigned long long> windows; // pings the tag read, first of each window
+static unsigned int answers; // tag pings on the reader channel
+static unsigned int waiting; // of them, answers to a busy ping
+static unsigned int downloads; // windows the tag listened on the download channel
+
+static unsigned long long lastDownload;
+
+static bool pingDue() {
+  if (rf.channel == DOWNLOAD_CHANNEL && emuUs - lastDownload > 1000000ULL) {
+    lastDownload = emuUs;
+    downloads++;
+  }
+  return rf.channel == READER_CHANNEL && emuUs - lastPing >= 10000;
+}
+
+static void readPing(void *buf, uint8_t len) {
+  byte ping[] = { CMD_PING, 0, 0, 0, busy };
+  memset(buf, 0, len);
+  memcpy(buf, ping, sizeof(ping));
+  if (emuUs - lastPing > 1000000ULL) windows.push_back(emuUs);
+  lastPing = emuUs;
+}
+
+static bool send(const void *buf, uint8_t len) {
+  const byte *b = (const byte *)buf;
+  if (rf.channel == READER_CHANNEL && b[0] == CMD_PING) {
+    answers++;
+    if (b[1] == 0 && b[2] == 7 && b[3] == PING_WAITING) waiting++;
+  }
+  return true;
+}
+
+// run the main loop for a while, return the gaps between the windows
+static std::vector<unsigned long> run(byte b, unsigned long ms) {
+  std::vector<unsigned long> gaps;
+  unsigned long long start = emuUs;
+
+  busy = b;
+  windows.clear();
+  answers = 0;
+  waiting = 0;
+  downloads = 0;
+  while (emuUs - start < ms * 1000ULL) {
+    loop();
+  }
+  for (size_t k = 1; k < windows.size(); k++) {
+    gaps.push_back((unsigned long)((windows[k] - windows[k - 1]) / 1000));
+  }
+  return gaps;
+}
+
+int main() {
+  std::vector<unsigned long> gaps;
+
+  emuEepromErase();
+  emuRadioReset();
+  emuEeprom[0] = 7; // tag 7, formatted
+  emuEeprom[1] = 0;
+  emuEeprom[2] = CHECK_BYTE1;
+  emuEeprom[3] = CHECK_BYTE2;
+  setup();
+  rfAvailHook = pingDue;
+  rfReadHook = readPing;
+  rfSendHook = send;
+  srand(5);
+
+  // busy for 2 s: back in 2 to 2.5 s, one waiting ping a window
+  gaps = run(20, 60000);
+  CHECK(gaps.size() > 20);
+  for (size_t k = 0; k < gaps.size(); k++) {
+    CHECK(gaps[k] >= 2000 && gaps[k] <= 2600);
+  }
+  CHECK_EQ(answers, windows.size());
+  CHECK_EQ(waiting, answers);
+  CHECK_EQ(downloads, 0);
+
+  // busy for longer than the reader period: the usual windows
+  gaps = run(255, 60000);
+  for (size_t k = 0; k < gaps.size(); k++) {
+    CHECK(gaps[k] >= READER_PERIOD_SECS * 1000UL - 100 && gaps[k] <= READER_PERIOD_SECS * 1000UL + 100);
+  }
+  CHECK_EQ(waiting, answers);
+  CHECK_EQ(downloads, 0);
+
+  // free: the tag answers and waits on the download channel
+  gaps = run(0, 20000);
+  CHECK(answers >= 3 * 3);
+  CHECK_EQ(waiting, 0);
+  CHECK(downloads >= 3);
+
+  return testResult("test_busy");
+}
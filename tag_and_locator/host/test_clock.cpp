@@ -0,0 +1,23 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// SecondsClock keeps step with millis(), called often or rarely
+
+#include "test.h"
+#include "tag.h"
+
+int main() {
+  emuCallUs = 0; // millis() stands still between the calls
+
+  srand(6);
+  for (int k = 0; k < 100000; k++) {
+    // mostly short steps, now and then a long sleep
+    unsigned long step = (k % 1000 == 0) ? rand() % 100000 : rand() % 1500;
+    emuAdvance(step);
+    CHECK_EQ(SecondsClock::seconds(), millis() / 1000);
+    CHECK_EQ(SecondsClock::msIntoSecond(), millis() % 1000);
+    if (testFailures > 0) break;
+  }
+  return testResult("test_clock");
+}
@@ -0,0 +1,244 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Downloads in every format against a model of the reader, on a clean
+// and a lossy link: everything arrives once, the index matches, and the
+// high-water mark only covers what the reader acked.
+
+#include "test.h"
+#include "tag.h"
+#include "link.h"
+
+#define ALL_NEW (DL_OPT_BULK | DL_OPT_FAST | DL_OPT_NEW | DL_OPT_RUN)
+
+typedef std::set<std::pair<unsigned int, unsigned long> > Records;
+
+// the records a full download sends, times relative to the session start
+static Records logged(Protocol *p) {
+  Records all;
+  UploadCursor c = UploadCursor();
+  TagData d;
+  while (HostTest::nextRecord(p, &c, &d)) {
+    all.insert(std::make_pair(d.tagid, d.firstSeenSeconds - p->sessionStartSecs));
+  }
+  return all;
+}
+
+static void download(Protocol *p, byte command, byte options, unsigned long since,
+    double loss, unsigned long cutMs) {
+  byte in[] = { command, (byte)(p->tagid >> 8), (byte)p->tagid, options,
+      (byte)(since >> 24), (byte)(since >> 16), (byte)(since >> 8), (byte)since };
+
+  linkBegin(loss, 2);
+  if (cutMs > 0) reader.cutUs = emuUs + cutMs * 1000ULL;
+  p->process(in, sizeof(in));
+  linkFinish();
+}
+
+static void formats(byte options, double loss) {
+  Protocol p;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  tagVisits(&p, 2000);
+  tagSettle(&p);
+  tagVisits(&p, 10); // some sessions still in RAM
+  Records all = logged(&p);
+
+  srand(3);
+  download(&p, CMD_DOWNLOAD, options | DL_OPT_RUN, 0, loss, 0);
+  CHECK(reader.indexed);
+  CHECK(!reader.gaveUp);
+  CHECK_EQ(reader.expected, all.size());
+  CHECK(reader.records == all);
+  CHECK(linkChecksumOk());
+  if (options & DL_OPT_BULK) {
+    CHECK_EQ(reader.received, all.size()); // no record printed twice
+    UploadCursor end = UploadCursor();
+    end.block = p.logBlocks;
+    CHECK_EQ(p.logMeta.uploaded, HostTest::recordSeq(&p, &end));
+  }
+  CHECK(!p.fastLink);
+}
+
+// incremental downloads pick up where the last acked one ended
+static void sweeps() {
+  Protocol p;
+  Records collected;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  srand(4);
+
+  tagVisits(&p, 1000);
+  tagSettle(&p);
+  download(&p, CMD_DOWNLOAD, ALL_NEW, 0, 0.1, 0);
+  CHECK_EQ(reader.received, p.logMeta.records);
+  collected.insert(reader.records.begin(), reader.records.end());
+
+  tagVisits(&p, 200);
+  tagSettle(&p);
+  download(&p, CMD_DOWNLOAD, ALL_NEW, 0, 0.1, 0);
+  CHECK(reader.received > 0 && reader.received < 300);
+  collected.insert(reader.records.begin(), reader.records.end());
+
+  // nothing new
+  download(&p, CMD_DOWNLOAD, ALL_NEW, 0, 0.1, 0);
+  CHECK_EQ(reader.received, 0);
+  CHECK(reader.done);
+
+  // the reader walks away halfway, the next sweep resumes
+  tagVisits(&p, 2000);
+  tagSettle(&p);
+  download(&p, CMD_DOWNLOAD, ALL_NEW, 0, 0.1, 150);
+  unsigned long partial = reader.received;
+  CHECK(partial > 0 && partial < 2000);
+  collected.insert(reader.records.begin(), reader.records.end());
+  download(&p, CMD_DOWNLOAD, ALL_NEW, 0, 0.1, 0);
+  CHECK(reader.received < 2000 + BULK_WINDOW * BULK_RECORDS - partial);
+  collected.insert(reader.records.begin(), reader.records.end());
+  CHECK(collected == logged(&p));
+
+  // from a sequence number
+  unsigned long mark = p.logMeta.uploaded;
+  download(&p, CMD_DOWNLOAD, DL_OPT_BULK | DL_OPT_SINCE | DL_OPT_RUN, mark - 50, 0, 0);
+  CHECK_EQ(reader.received, 50);
+  CHECK_EQ(p.logMeta.uploaded, mark);
+
+  // the mark survives a reboot
+  Protocol q;
+  q.begin(5, &radio, &eeprom);
+  CHECK_EQ(q.logMeta.uploaded, mark);
+}
+
+// the log is only reset once the reader acked every record
+static void downloadAndReset() {
+  Protocol p;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  srand(5);
+  tagVisits(&p, 300);
+  tagSettle(&p);
+
+  download(&p, CMD_DL_AND_RESET, ALL_NEW & ~DL_OPT_RUN, 0, 0.1, 30);
+  CHECK(p.logMeta.records > 0);
+
+  download(&p, CMD_DL_AND_RESET, ALL_NEW & ~DL_OPT_RUN, 0, 0.1, 0);
+  CHECK(reader.received > 0);
+  CHECK_EQ(p.logMeta.records, 0);
+  CHECK(p.isStopped);
+}
+
+// A download that keeps the tag busy for longer than 256 s, with
+// sessions in RAM. They keep their last seen time and expire after it.
+static void longUpload() {
+  Protocol p;
+
+  tagFormat(3, 0x40000UL, 256);
+  tagStart(&p, 5);
+  tagVisits(&p, 11000, 3000);
+  tagSettle(&p);
+  for (unsigned int peer = 900; peer < 905; peer++) tagPing(&p, peer);
+  unsigned long seen = p.seconds();
+  emuAdvance(10000);
+
+  // printed at 9600 baud
+  unsigned long long t = emuUs;
+  byte in[] = { CMD_DOWNLOAD, 0, 5, DL_OPT_BULK | DL_OPT_RUN };
+  linkBegin(0, 26);
+  p.process(in, sizeof(in));
+  linkFinish();
+  CHECK(emuUs - t > 256000000ULL);
+  CHECK(reader.done);
+
+  // all of them timed out during the upload, staged as the EEPROM
+  // takes them
+  for (int k = 0; k < 10; k++) {
+    emuAdvance(5);
+    p.tick();
+  }
+  CHECK_EQ(p.sessions.count, 0);
+  p.flushStaged();
+
+  unsigned int found = 0;
+  UploadCursor c = UploadCursor();
+  TagData d;
+  while (HostTest::nextRecord(&p, &c, &d)) {
+    if (d.tagid >= 900 && d.tagid < 905) {
+      CHECK_EQ(d.lastSeenSeconds, seen);
+      found++;
+    }
+  }
+  CHECK_EQ(found, 5);
+}
+
+// A packed download of a full 256K part sends the index right away,
+// the dictionary comes from the first records only. A partial one goes
+// through its records first, within the reader's wait.
+static void packedIndex() {
+  Protocol p;
+  byte all[] = { CMD_DOWNLOAD, 0, 5, DL_OPT_BULK | DL_OPT_PACK | DL_OPT_RUN };
+  byte since[] = { CMD_DOWNLOAD, 0, 5,
+      DL_OPT_BULK | DL_OPT_PACK | DL_OPT_SINCE | DL_OPT_RUN, 0, 0, 0, 1 };
+
+  tagFormat(3, 0x40000UL, 256);
+  tagStart(&p, 5);
+  tagVisits(&p, 11000, 3000);
+  tagSettle(&p);
+
+  linkBegin(0, 0);
+  p.process(all, sizeof(all));
+  linkFinish();
+  CHECK(reader.firstUs < 100000UL);
+  CHECK(reader.done);
+  CHECK_EQ(reader.received, p.logMeta.records);
+  CHECK(linkChecksumOk());
+
+  linkBegin(0, 0);
+  p.process(since, sizeof(since));
+  linkFinish();
+  CHECK(reader.firstUs > 100000UL);
+  CHECK(reader.done);
+  CHECK_EQ(reader.received, p.logMeta.records - 1);
+  CHECK(linkChecksumOk());
+}
+
+// The index switches the reader to the download profile. The tag
+// follows only once the index is acked, also when the ack got lost.
+static void lostIndex(unsigned int losses, unsigned int ackLosses, boolean fast) {
+  Protocol p;
+  byte in[] = { CMD_DOWNLOAD, 0, 5, DL_OPT_BULK | DL_OPT_FAST | DL_OPT_RUN };
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  tagVisits(&p, 300);
+  tagSettle(&p);
+
+  linkBegin(0, 2);
+  reader.indexLosses = losses;
+  reader.indexAckLosses = ackLosses;
+  p.process(in, sizeof(in));
+  linkFinish();
+  CHECK_EQ(reader.fast, fast);
+  CHECK_EQ(reader.records.size(), p.logMeta.records);
+  CHECK(!p.fastLink);
+}
+
+int main() {
+  formats(0, 0);
+  formats(DL_OPT_BULK, 0);
+  formats(DL_OPT_BULK | DL_OPT_FAST, 0);
+  formats(DL_OPT_BULK | DL_OPT_FAST | DL_OPT_PACK, 0);
+  formats(DL_OPT_BULK, 0.1);
+  formats(DL_OPT_BULK | DL_OPT_FAST | DL_OPT_PACK, 0.1);
+  sweeps();
+  downloadAndReset();
+  longUpload();
+  packedIndex();
+  lostIndex(1, 0, true);
+  lostIndex(0, 1, true);
+  lostIndex(1000, 0, false); // the reader never gets it
+  return testResult("test_download");
+}
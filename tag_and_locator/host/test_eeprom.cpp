@@ -0,0 +1,55 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// EEPROM driver on parts with 2 and 3 byte addresses: detection of the
+// geometry, page writes and the session log sized to the part.
+
+#include "test.h"
+#include "tag.h"
+
+static void geometry(int addrBytes, unsigned long size, unsigned long pageSize) {
+  byte header[] = { 0, 0, CHECK_BYTE1, CHECK_BYTE2 };
+  byte check[] = { CHECK_BYTE1, CHECK_BYTE2 };
+  byte buf[300];
+  byte back[300];
+  Eeprom e;
+
+  emuEepromErase();
+  emuAddrBytes = addrBytes;
+  emuEepromSize = size;
+  emuPageSize = pageSize;
+  e.begin();
+  CHECK_EQ(e.signature(), 0x29);
+
+  // unprogrammed: nothing to detect, format finds the address width
+  CHECK(!e.detect(2, check, sizeof(check)));
+  CHECK(e.format(0, header, sizeof(header)));
+  CHECK_EQ(e.size(), size);
+
+  // after a reboot
+  Eeprom again;
+  again.begin();
+  CHECK(again.detect(2, check, sizeof(check)));
+  CHECK_EQ(again.size(), size);
+
+  // a block across pages, near the end of the part
+  for (unsigned int k = 0; k < sizeof(buf); k++) buf[k] = k * 7;
+  CHECK(again.writeBlock(size - 400, buf, sizeof(buf)));
+  again.readBlock(size - 400, back, sizeof(back));
+  CHECK(memcmp(buf, back, sizeof(buf)) == 0);
+  CHECK_EQ(again.read(size - 400 + 129), buf[129]);
+
+  // the log fills the part after the settings page
+  Protocol p;
+  p.begin(5, &radio, &again);
+  unsigned long blocks = (size - EEPROM_LOG_START) / EEPROM_PAGE_SIZE;
+  CHECK_EQ(p.logCapacity, blocks > MAX_LOG_BLOCKS ? MAX_LOG_BLOCKS : blocks);
+}
+
+int main() {
+  geometry(2, 0x10000UL, 128); // 25LC512
+  geometry(3, 0x20000UL, 256); // 25LC1024
+  geometry(3, 0x40000UL, 256); // 2 Mbit
+  return testResult("test_eeprom");
+}
@@ -0,0 +1,115 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// Tags in range of an inventory each reply until a beacon acks them,
+// then sit out the rest of the round
+
+#include <set>
+#include <vector>
+#include "test.h"
+#include "tag.h"
+
+#define TAGS 40
+
+// as the reader
+#define INVENTORY_Q 4
+#define INVENTORY_C 5
+
+static std::vector<unsigned int> replies;
+
+static bool reply(const void *buf, uint8_t len) {
+  const byte *b = (const byte *)buf;
+  if (b[0] == PKT_INVENTORY) replies.push_back(((unsigned int)b[1] << 8) | b[2]);
+  return true;
+}
+
+// runs the reader side of inventory() over the tags until a frame of
+// beacons gets no replies, returns the tags acked
+static std::multiset<unsigned int> inventory(Protocol *tags, unsigned int round,
+    unsigned int *beacons) {
+  std::multiset<unsigned int> acked;
+  byte beacon[32];
+  byte qfp = INVENTORY_Q * 16;
+  byte q = INVENTORY_Q;
+  byte frame = 0;
+  unsigned int slotsLeft = 1 << q;
+  unsigned int ack = 0;
+  unsigned int idle = 0;
+  unsigned int taking = TAGS;
+
+  memset(beacon, 0, sizeof(beacon));
+  beacon[0] = CMD_INVENTORY;
+  beacon[1] = round >> 8;
+  beacon[2] = round;
+  *beacons = 0;
+  while (idle < 300 && *beacons < 10000) {
+    beacon[3] = q;
+    beacon[4] = frame;
+    beacon[5] = ack >> 8;
+    beacon[6] = ack;
+    replies.clear();
+    taking = 0;
+    for (int k = 0; k < TAGS; k++) {
+      if (tags[k].handleInventory(beacon, sizeof(beacon))) taking++;
+    }
+    (*beacons)++;
+
+    ack = 0;
+    if (replies.size() == 1) {
+      ack = replies[0];
+      acked.insert(ack);
+      idle = 0;
+    } else if (replies.size() > 1) {
+      idle = 0;
+      if (qfp <= INVENTORY_MAX_Q * 16 - INVENTORY_C) qfp += INVENTORY_C;
+    } else {
+      idle++;
+      if (qfp >= INVENTORY_C) qfp -= INVENTORY_C;
+    }
+
+    byte next = (qfp + 8) / 16;
+    if (--slotsLeft == 0 || next != q) {
+      q = next;
+      frame++;
+      slotsLeft = 1 << q;
+    }
+  }
+
+  // the ack of the last reply is in the last beacon, after that none
+  // of the tags takes part any more
+  CHECK_EQ(taking, 0);
+  return acked;
+}
+
+int main() {
+  static Protocol tags[TAGS];
+  unsigned int beacons;
+
+  tagFormat(2, 0x10000UL, 128);
+  for (int k = 0; k < TAGS; k++) tagStart(&tags[k], 100 + k);
+  rfSendHook = reply;
+  srand(8);
+
+  for (unsigned int round = 1; round <= 5; round++) {
+    std::multiset<unsigned int> acked = inventory(tags, round * 0x101, &beacons);
+    CHECK_EQ(acked.size(), TAGS);
+    for (int k = 0; k < TAGS; k++) CHECK_EQ(acked.count(100 + k), 1);
+    // about e slots a tag once Q follows the crowd
+    CHECK(beacons - 300 < TAGS * 5);
+
+    // a repeated beacon of the round is ignored
+    byte beacon[7] = { CMD_INVENTORY, (byte)(round * 0x101 >> 8), (byte)(round * 0x101), 0, 0, 0, 0 };
+    replies.clear();
+    for (int k = 0; k < TAGS; k++) CHECK(!tags[k].handleInventory(beacon, sizeof(beacon)));
+    CHECK(replies.empty());
+  }
+
+  // a short beacon of a new round is dropped before it is read
+  byte shortBeacon[3] = { CMD_INVENTORY, 0x7F, 0x7F };
+  replies.clear();
+  for (int k = 0; k < TAGS; k++) CHECK(!tags[k].handleInventory(shortBeacon, sizeof(shortBeacon)));
+  CHECK(replies.empty());
+
+  return testResult("test_inventory");
+}
@@ -0,0 +1,242 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// The session log in EEPROM: records survive a reboot, resets, the
+// overflow policies, and sessions spilled from a full RAM table.
+
+#include <map>
+#include <vector>
+#include "test.h"
+#include "tag.h"
+
+// the records a download would send, in order
+static std::vector<TagData> records(Protocol *p) {
+  std::vector<TagData> all;
+  UploadCursor c = UploadCursor();
+  TagData d;
+  while (HostTest::nextRecord(p, &c, &d)) all.push_back(d);
+  return all;
+}
+
+static boolean sameRecords(const std::vector<TagData> &a, const std::vector<TagData> &b) {
+  if (a.size() != b.size()) return false;
+  for (size_t k = 0; k < a.size(); k++) {
+    if (a[k].tagid != b[k].tagid || a[k].firstSeenSeconds != b[k].firstSeenSeconds ||
+        a[k].lastSeenSeconds != b[k].lastSeenSeconds) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the 16-bit sum of LogMeta.checksum
+static uint16_t checksum(const std::vector<TagData> &a) {
+  uint16_t sum = 0;
+  for (size_t k = 0; k < a.size(); k++) {
+    sum += a[k].tagid + (uint16_t)(a[k].lastSeenSeconds - a[k].firstSeenSeconds);
+  }
+  return sum;
+}
+
+static void reboot() {
+  Protocol p;
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  unsigned long page0 = emuPage0Writes;
+  tagVisits(&p, 3000);
+  tagSettle(&p);
+
+  // page 0 holds the tag id and settings, logging leaves it alone
+  CHECK_EQ(emuPage0Writes, page0);
+
+  std::vector<TagData> before = records(&p);
+  CHECK_EQ(before.size(), p.logMeta.records);
+  CHECK_EQ(checksum(before), p.logMeta.checksum);
+
+  // the write cursor and index are recovered at boot
+  Protocol q;
+  q.begin(5, &radio, &eeprom);
+  CHECK_EQ(q.logBlocks, p.logBlocks);
+  CHECK_EQ(q.blockRecords, p.blockRecords);
+  CHECK_EQ(q.logMeta.records, p.logMeta.records);
+  CHECK_EQ(q.logMeta.checksum, p.logMeta.checksum);
+  CHECK_EQ(q.logMeta.firstSeconds, p.logMeta.firstSeconds);
+  CHECK_EQ(q.logMeta.lastSeconds, p.logMeta.lastSeconds);
+  CHECK(sameRecords(records(&q), before));
+
+  // a reset is one write, the blocks are stale after it
+  unsigned long cycles = emuWriteCycles;
+  q.resetData();
+  CHECK(emuWriteCycles - cycles <= 2);
+  Protocol r;
+  r.begin(5, &radio, &eeprom);
+  CHECK_EQ(r.logBlocks, 0);
+  CHECK_EQ(records(&r).size(), 0);
+}
+
+static void overflow(byte policy) {
+  Protocol p;
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  p.metaData.overflowPolicy = policy;
+
+  // more records than the log holds, before the tag stops itself
+  unsigned long capacity = (unsigned long)p.logCapacity * RECORDS_PER_BLOCK;
+  tagVisits(&p, capacity + 2000, 3000);
+  tagSettle(&p);
+
+  std::vector<TagData> all = records(&p);
+  CHECK_EQ(all.size(), p.logMeta.records);
+  CHECK_EQ(checksum(all), p.logMeta.checksum);
+  CHECK(p.logMeta.dropped > 0);
+  CHECK(all.size() <= capacity);
+  if (policy == OVERFLOW_STOP) {
+    CHECK(p.isStopped);
+  } else {
+    CHECK(!p.isStopped);
+  }
+
+  // in time order, and overwriting keeps the latest
+  unsigned int late = 0;
+  for (size_t k = 1; k < all.size(); k++) {
+    if (all[k].lastSeenSeconds + BLOCK_BASE_SLACK < all[k - 1].lastSeenSeconds) late++;
+  }
+  CHECK_EQ(late, 0);
+  if (policy == OVERFLOW_OVERWRITE) {
+    CHECK(all.back().lastSeenSeconds + 1000 > p.seconds() - 200);
+  }
+
+  // and after a reboot
+  Protocol q;
+  q.begin(5, &radio, &eeprom);
+  CHECK(sameRecords(records(&q), all));
+}
+
+// A crowd of peers, more than fit in RAM, each seen now and then. Spilled
+// sessions are resumed, so no peer has overlapping records.
+static void spill() {
+  Protocol p;
+  std::map<unsigned int, std::vector<TagData> > byPeer;
+  unsigned long lost = 0;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  srand(2);
+  for (int k = 0; k < 3000; k++) {
+    emuAdvance(2000);
+    for (unsigned int peer = 1; peer <= 40; peer++) {
+      if (rand() % 100 < 30) {
+        tagPing(&p, peer);
+        if (p.sessions.find(peer) == NULL) lost++;
+      }
+    }
+    p.tick();
+  }
+  tagSettle(&p);
+
+  CHECK_EQ(lost, 0);
+  std::vector<TagData> all = records(&p);
+  for (size_t k = 0; k < all.size(); k++) byPeer[all[k].tagid].push_back(all[k]);
+  CHECK_EQ(byPeer.size(), 40);
+
+  unsigned int overlaps = 0;
+  for (std::map<unsigned int, std::vector<TagData> >::iterator it = byPeer.begin();
+      it != byPeer.end(); ++it) {
+    std::vector<TagData> &v = it->second;
+    for (size_t a = 0; a < v.size(); a++) {
+      for (size_t b = a + 1; b < v.size(); b++) {
+        if (v[a].firstSeenSeconds < v[b].lastSeenSeconds &&
+            v[b].firstSeenSeconds < v[a].lastSeenSeconds) {
+          overlaps++;
+        }
+      }
+    }
+  }
+  CHECK_EQ(overlaps, 0);
+}
+
+// A spilled session is resumed after its partial record is no longer in
+// the block being filled.
+static void resumeAcrossBlocks() {
+  Protocol p;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  tagPing(&p, 1);
+  unsigned long first = p.seconds();
+  emuAdvance(2000);
+  for (unsigned int peer = 2; peer <= MAX_RAM_SESSIONS; peer++) tagPing(&p, peer);
+  emuAdvance(2000);
+  tagPing(&p, 100); // spills peer 1
+  p.flushStaged();
+  unsigned int block = p.logBlocks;
+
+  // records of other peers fill the rest of the block and start another
+  for (unsigned int k = 0; k < RECORDS_PER_BLOCK; k++) {
+    p.staged[0].tagid = 200 + k;
+    p.staged[0].start = p.seconds() - p.sessionStartSecs;
+    p.staged[0].lastSeen = p.seconds();
+    p.stagedCount = 1;
+    p.flushStaged();
+  }
+  CHECK(p.logBlocks > block);
+
+  emuAdvance(2000);
+  tagPing(&p, 1);
+  tagSettle(&p);
+
+  unsigned int found = 0;
+  std::vector<TagData> all = records(&p);
+  for (size_t k = 0; k < all.size(); k++) {
+    if (all[k].tagid != 1) continue;
+    found++;
+    CHECK_EQ(all[k].firstSeenSeconds, first);
+  }
+  CHECK_EQ(found, 1);
+}
+
+// Pings are handled while a page write is in progress, with a slow
+// write cycle: the tag never waits on the EEPROM in a listen window.
+static void writeInProgress() {
+  Protocol p;
+  unsigned long writeUs = emuWriteUs;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  emuWriteUs = 50000;
+  tagPing(&p, 1);
+  tagIdle(&p, (SESSION_TIMEOUT_SECS + 2) * 1000UL); // stages and writes it
+  p.flushStaged();
+
+  tagPing(&p, 2);
+  tagIdle(&p, SESSION_TIMEOUT_SECS * 1000UL);
+  emuAdvance(2000);
+  p.tick(); // peer 2 times out, its record is being written
+  CHECK_EQ(p.stagedCount, 0);
+  CHECK(!eeprom.ready());
+
+  // a listen window's worth of pings from new peers
+  unsigned long long start = emuUs;
+  for (unsigned int peer = 10; peer < 20; peer++) {
+    byte ping[] = { CMD_PING, 0, (byte)peer, 0 };
+    p.process(ping, sizeof(ping));
+    p.pollStorage();
+    CHECK(p.sessions.find(peer) != NULL);
+  }
+  CHECK(!eeprom.ready());
+  CHECK(emuUs - start < 1000);
+
+  emuWriteUs = writeUs;
+}
+
+int main() {
+  reboot();
+  overflow(OVERFLOW_OVERWRITE);
+  overflow(OVERFLOW_DROP);
+  overflow(OVERFLOW_STOP);
+  spill();
+  resumeAcrossBlocks();
+  writeInProgress();
+  return testResult("test_log");
+}
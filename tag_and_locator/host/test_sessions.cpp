@@ -0,0 +1,115 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+// The RAM session hash table against a std::set, with a clock the test
+// sets, and the tag's use of it.
+
+#include <set>
+#include "test.h"
+#include "tag.h"
+
+struct TestClock {
+  static unsigned long now;
+  static unsigned long seconds() { return now; }
+};
+unsigned long TestClock::now = 0;
+
+typedef SessionTable<TestClock, 12, 32> Table;
+
+// every stored session is reachable from its home slot without a hole
+static boolean reachable(Table *t, unsigned int id) {
+  byte slot = HostTest::home<Table>(id);
+  for (byte n = 0; n < Table::slots; n++) {
+    if (t->table[slot] == 0) return false;
+    if (t->entries[t->table[slot] - 1].tagid == id) return true;
+    slot = (slot + 1) & Table::mask;
+  }
+  return false;
+}
+
+// the table holds each of the count entries exactly once
+static boolean consistent(Table *t) {
+  byte seen[Table::capacity] = { 0 };
+  byte used = 0;
+  for (byte j = 0; j < Table::slots; j++) {
+    if (t->table[j] == 0) continue;
+    if (t->table[j] > t->count || seen[t->table[j] - 1]++) return false;
+    used++;
+  }
+  return used == t->count;
+}
+
+static void randomOps() {
+  Table t;
+  std::set<unsigned int> ref;
+
+  t.clear();
+  srand(1);
+  for (long k = 0; k < 200000; k++) {
+    // tags in sequence and a few locators, which hash alike
+    unsigned int id = (rand() % 4 == 0) ? (0x8000 | (rand() % 8)) : (rand() % 16 + 1);
+    if (rand() % 2) {
+      SessionLookup *s = t.find(id);
+      if (ref.count(id)) {
+        CHECK(s != NULL && s->tagid == id);
+      } else {
+        CHECK(s == NULL);
+        s = t.insert(id);
+        if (ref.size() < Table::capacity) {
+          CHECK(s != NULL);
+          ref.insert(id);
+        } else {
+          CHECK(s == NULL);
+        }
+      }
+    } else if (ref.count(id)) {
+      t.remove(t.find(id) - t.entries);
+      ref.erase(id);
+    }
+
+    CHECK_EQ(t.count, ref.size());
+    CHECK(consistent(&t));
+    for (std::set<unsigned int>::iterator it = ref.begin(); it != ref.end(); ++it) {
+      CHECK(reachable(&t, *it));
+    }
+    if (testFailures > 0) return;
+  }
+}
+
+static void ages() {
+  Table t;
+
+  t.clear();
+  TestClock::now = 1000;
+  t.insert(7)->lastSeen = TestClock::now - 30;
+  t.insert(8)->lastSeen = TestClock::now - 90;
+  t.insert(9)->lastSeen = TestClock::now;
+  CHECK_EQ(Table::age(t.find(8)), 90);
+  CHECK_EQ(t.entries[t.oldest()].tagid, 8);
+}
+
+// sessions of the tag: kept while seen, logged once they time out
+static void tagSessions() {
+  Protocol p;
+
+  tagFormat(2, 0x10000UL, 128);
+  tagStart(&p, 5);
+  for (int k = 0; k < 20; k++) {
+    tagPing(&p, 100 + k % 4);
+    tagIdle(&p, 10000);
+  }
+  CHECK_EQ(p.sessions.count, 4);
+  CHECK_EQ(p.logMeta.records, 0);
+
+  tagSettle(&p);
+  CHECK_EQ(p.sessions.count, 0);
+  CHECK_EQ(p.logMeta.records, 4);
+}
+
+int main() {
+  randomOps();
+  ages();
+  tagSessions();
+  return testResult("test_sessions");
+}
@@ -5,12 +5,82 @@
 
 /* Constructor */
 Eeprom::Eeprom() {
-  _addrwidth = 16 / 8;
+  _addrwidth = EEPROM_ADDR_BYTES;
+  _size = EEPROM_CAPACITY;
+  _signature = 0;
+  _busy = false;
+  #ifdef EEPROM_STATS
+  transactions = 0;
+  #endif
 }
 
 void Eeprom::begin() {
   pinMode( EEPROM_CS, OUTPUT);
   digitalWrite(EEPROM_CS, HIGH);  // idle
+
+  // release from deep power-down and read the electronic signature. The
+  // 25LC512 and 25LC1024 share a signature, so it doesn't tell the
+  // geometry apart, see detect().
+  EEPROM_TRANSACTION();
+  digitalWrite(EEPROM_CS, LOW);
+  SPI.transfer(SPIEEP_RDID);
+  for (byte i = 0; i < 3; i++) SPI.transfer(0x0); // dummy address
+  _signature = SPI.transfer(0x0);
+  digitalWrite(EEPROM_CS, HIGH);
+}
+
+// Try each address width until the header reads back. A 2-byte read on
+// a 3-byte part is shifted by one byte, so it won't match. The capacity
+// is where the address wraps around to the header again.
+boolean Eeprom::detect(uint32_t p, const byte *header, byte len) {
+  for (_addrwidth = 2; _addrwidth <= 3; _addrwidth++) {
+    if (_matches(p, header, len)) {
+      _detectSize(p, header, len);
+      return true;
+    }
+  }
+
+  // unprogrammed, keep the defaults
+  _addrwidth = EEPROM_ADDR_BYTES;
+  _size = EEPROM_CAPACITY;
+  return false;
+}
+
+// A write with the wrong address width lands somewhere in the first
+// pages, which are still unprogrammed at this point.
+boolean Eeprom::format(uint32_t p, const byte *header, byte len) {
+  for (_addrwidth = 2; _addrwidth <= 3; _addrwidth++) {
+    writeBlock(p, header, len);
+    if (_matches(p, header, len)) {
+      _detectSize(p, header, len);
+      return true;
+    }
+  }
+
+  _addrwidth = EEPROM_ADDR_BYTES;
+  _size = EEPROM_CAPACITY;
+  return false;
+}
+
+void Eeprom::_detectSize(uint32_t p, const byte *header, byte len) {
+  for (_size = 0x1000; _size < (1UL << (8 * _addrwidth)); _size <<= 1) {
+    if (_matches(p + _size, header, len)) break;
+  }
+}
+
+boolean Eeprom::_matches(uint32_t p, const byte *buf, byte len) {
+  for (byte i = 0; i < len; i++) {
+    if (read(p + i) != buf[i]) return false;
+  }
+  return true;
+}
+
+uint32_t Eeprom::size() {
+  return _size;
+}
+
+byte Eeprom::signature() {
+  return _signature;
 }
 
 // read status register
@@ -18,6 +88,7 @@ byte Eeprom::readStatus()
 {
   byte ret;
 
+  EEPROM_TRANSACTION();
   digitalWrite(EEPROM_CS, LOW);
   SPI.transfer(SPIEEP_RDSR);
   ret = SPI.transfer(0x0);
@@ -38,6 +109,8 @@ void Eeprom::_write_address(uint32_t p) {
 byte Eeprom::read(uint32_t p) {
   byte ret;
 
+  waitReady();
+  EEPROM_TRANSACTION();
   digitalWrite(EEPROM_CS, LOW);
   SPI.transfer(SPIEEP_READ);
   _write_address(p);
@@ -47,8 +120,23 @@ byte Eeprom::read(uint32_t p) {
   return ret;
 }
 
+// read a block of bytes. The address counter auto-increments while CS
+// is held low, so the whole block costs a single SPI transaction.
+void Eeprom::readBlock(uint32_t p, byte *buf, unsigned int len) {
+  waitReady();
+  EEPROM_TRANSACTION();
+  digitalWrite(EEPROM_CS, LOW);
+  SPI.transfer(SPIEEP_READ);
+  _write_address(p);
+  while (len-- > 0) {
+    *buf++ = SPI.transfer(0x0);
+  }
+  digitalWrite(EEPROM_CS, HIGH);
+}
+
 // enable write
 void Eeprom::wren() {
+  EEPROM_TRANSACTION();
   digitalWrite(EEPROM_CS, LOW);
   SPI.transfer(SPIEEP_WREN);
   digitalWrite(EEPROM_CS, HIGH);
@@ -56,6 +144,7 @@ void Eeprom::wren() {
 
 // disable write
 void Eeprom::wrdi() {
+  EEPROM_TRANSACTION();
   digitalWrite(EEPROM_CS, LOW);
   SPI.transfer(SPIEEP_WRDI);
   digitalWrite(EEPROM_CS, HIGH);
@@ -73,30 +162,86 @@ boolean Eeprom::is_wren() {
 
 // write a byte
 boolean Eeprom::write(uint32_t p, byte b) {
+  return writePage(p, &b, 1);
+}
 
+// write up to a page of bytes. The caller must make sure the bytes do
+// not cross a page boundary, otherwise the address wraps within the page.
+boolean Eeprom::writePage(uint32_t p, const byte *buf, unsigned int len,
+    unsigned int zeroPad) {
+  if (!startWrite(p, buf, len, zeroPad))
+    return false;
+
+  return _write_validation();
+}
+
+// start a page write. The data is latched by the EEPROM when CS goes
+// high, so buf can be reused as soon as this returns.
+boolean Eeprom::startWrite(uint32_t p, const byte *buf, unsigned int len,
+    unsigned int zeroPad) {
+
+  waitReady();
   wren();
   if (!is_wren())
     return false;  // Couldn't enable WREN for some reason?
+  EEPROM_TRANSACTION();
   digitalWrite(EEPROM_CS, LOW);
   SPI.transfer(SPIEEP_WRITE);
   _write_address(p);
-  SPI.transfer(b);
+  while (len-- > 0) {
+    SPI.transfer(*buf++);
+  }
+  while (zeroPad-- > 0) {
+    SPI.transfer(0x0);
+  }
   digitalWrite(EEPROM_CS, HIGH);
 
-  return _write_validation();
+  _busy = true;
+  _writeStart = millis();
+  return true;
 }
 
-boolean Eeprom::_write_validation() {
-  long m = millis();
-  byte ret;
+// Check the Write-In-Progress status bit of a started write. Gives up
+// after 20ms (timeout), no write operations should take more than 10ms.
+boolean Eeprom::ready() {
+  if (_busy) {
+    if (((readStatus() >> SPIEEP_STATUS_WIP) & 0x01) == 0x01 &&
+        (millis() - _writeStart) < 20) {
+      return false;
+    }
+    _busy = false;
+  }
+
+  return true;
+}
 
-  // Wait until the Write-In-Progress status register has cleared
-  // Or 20ms (timeout) has passed, whichever happens first.  No write operations
-  // should take more than 10ms or so.
-  do {
+void Eeprom::waitReady() {
+  while (!ready()) {
     delayMicroseconds(200);
-    ret = readStatus();
-  } while (((ret >> SPIEEP_STATUS_WIP) & 0x01) == 0x01 && (millis() - m) < 20);
+  }
+}
+
+// write a block of bytes, one write cycle per page touched
+boolean Eeprom::writeBlock(uint32_t p, const byte *buf, unsigned int len) {
+  boolean ret = true;
+  unsigned int n;
+
+  while (len > 0) {
+    // bytes left until the end of the current page
+    n = EEPROM_PAGE_SIZE - (unsigned int)(p % EEPROM_PAGE_SIZE);
+    if (n > len) n = len;
+    if (!writePage(p, buf, n)) ret = false;
+    p += n;
+    buf += n;
+    len -= n;
+  }
+
+  return ret;
+}
+
+boolean Eeprom::_write_validation() {
+  // Wait until the Write-In-Progress status register has cleared
+  waitReady();
 
   // Check if Write-Enable has cleared to validate whether this command succeeded.
   return !is_wren();
@@ -3,6 +3,20 @@
 
 #define EEPROM_CS P2_5
 
+// Write page size of the EEPROM (25LC512). A single WRITE command may
+// not cross a page boundary, but a full page is written in one cycle.
+// Larger parts have 256 byte pages, 128 byte writes are safe on those.
+#define EEPROM_PAGE_SIZE 128
+
+// Geometry used when it can't be detected, i.e. on an unprogrammed
+// EEPROM. Override with build_flags, e.g. -D EEPROM_ADDR_BYTES=3
+#ifndef EEPROM_ADDR_BYTES
+  #define EEPROM_ADDR_BYTES 2
+#endif
+#ifndef EEPROM_CAPACITY
+  #define EEPROM_CAPACITY 0x10000UL
+#endif
+
 //SPI EEPROM Instruction Set
 #define SPIEEP_READ 0x03
 #define SPIEEP_WRITE 0x02
@@ -23,6 +37,14 @@
 #define SPIEEP_STATUS_WEL 1
 #define SPIEEP_STATUS_WIP 0
 
+// Count SPI transactions (chip selects) for profiling storage access.
+// Enable with build_flags = -D EEPROM_STATS
+#ifdef EEPROM_STATS
+  #define EEPROM_TRANSACTION() transactions++
+#else
+  #define EEPROM_TRANSACTION()
+#endif
+
 class Eeprom {
   public:
     Eeprom();
@@ -30,6 +52,20 @@ class Eeprom {
     // setup eeprom
     void begin();
 
+    // detect address width and capacity from a header known to be
+    // stored at address p, returns false if the header is not there
+    boolean detect(uint32_t p, const byte *header, byte len);
+
+    // write the header for detect() on an unprogrammed part, trying each
+    // address width until it reads back
+    boolean format(uint32_t p, const byte *header, byte len);
+
+    // capacity in bytes
+    uint32_t size();
+
+    // electronic signature read at begin()
+    byte signature();
+
     // read status register
     byte readStatus();
 
@@ -38,6 +74,9 @@ class Eeprom {
 
     // read a byte
     byte read(uint32_t p);
+
+    // read len bytes starting at p in a single sequential read
+    void readBlock(uint32_t p, byte *buf, unsigned int len);
     
     // enable write
     void wren();
@@ -51,8 +90,37 @@ class Eeprom {
     // write a byte
     boolean write(uint32_t p, byte b);
 
+    // write len bytes within a single page, followed by zeroPad zero
+    // bytes, and wait for it to complete
+    boolean writePage(uint32_t p, const byte *buf, unsigned int len,
+        unsigned int zeroPad = 0);
+
+    // like writePage, but return as soon as the data is sent and leave
+    // the write cycle running. Poll ready() to see when it is done.
+    boolean startWrite(uint32_t p, const byte *buf, unsigned int len,
+        unsigned int zeroPad = 0);
+
+    // check if a started write has completed, never blocks
+    boolean ready();
+
+    // wait for a started write to complete
+    void waitReady();
+
+    // write len bytes, split at page boundaries into page writes
+    boolean writeBlock(uint32_t p, const byte *buf, unsigned int len);
+
+    #ifdef EEPROM_STATS
+    unsigned long transactions; // number of chip selects since reset
+    #endif
+
   private:
     int _addrwidth;
+    uint32_t _size;
+    byte _signature;
+    boolean _matches(uint32_t p, const byte *buf, byte len);
+    void _detectSize(uint32_t p, const byte *header, byte len);
+    boolean _busy; // a write cycle may be in progress
+    unsigned long _writeStart;
     boolean _write_validation();
     
 };
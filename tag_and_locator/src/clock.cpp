@@ -0,0 +1,25 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+#include "clock.h"
+
+unsigned long SecondsClock::secs = 0;
+unsigned long SecondsClock::secStartMs = 0;
+
+unsigned long SecondsClock::seconds() {
+  unsigned long now = millis();
+
+  // catch up one second at a time, called often this is a single step
+  while (now - secStartMs >= 1000) {
+    secStartMs += 1000;
+    secs++;
+  }
+  return secs;
+}
+
+// milliseconds since the current second started
+unsigned int SecondsClock::msIntoSecond() {
+  seconds();
+  return millis() - secStartMs;
+}
@@ -0,0 +1,24 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+#ifndef _RFT_CLOCK_H
+#define _RFT_CLOCK_H
+
+#include <Energia.h>
+
+// Seconds since boot, counted up from millis() instead of dividing it:
+// the MSP430G2553 has no hardware divider, so millis() / 1000 is a
+// software 32-bit division on every call. millis() keeps running
+// through sleep() and stops in suspend(), so does this clock.
+class SecondsClock {
+  public:
+    static unsigned long seconds();
+    static unsigned int msIntoSecond();
+
+  private:
+    static unsigned long secs; // seconds counted so far
+    static unsigned long secStartMs; // millis() at the start of secs
+};
+
+#endif
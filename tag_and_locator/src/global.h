@@ -26,6 +26,13 @@
 #define NRF_SPEED         RF24_1MBPS
 //#define AUTO_ACK
 
+// Download profile, negotiated with DL_OPT_FAST. The reader is close by
+// during a download, so trade range for speed. Pings keep the settings
+// above for range.
+#define FAST_SPEED        RF24_2MBPS
+#define FAST_RETRY_DELAY  1     // (n + 1) * 250 us between hw retries
+#define FAST_RETRY_COUNT  15
+
 // ====================================================================
 // The following are defaults to be written to EEPROM. They can be
 // reconfigured later over-the-air using CMD_SETTINGS
@@ -48,6 +55,12 @@
 // at least LISTEN_DURATION * 3 (in case we missed one ping)
 #define SESSION_TIMEOUT_SECS    120
 #define AUTO_STOP_SECONDS       43200 // auto-stop after 12 hours 
+
+// what to do when the session log in EEPROM is full
+#define OVERFLOW_OVERWRITE      0     // overwrite the oldest sessions
+#define OVERFLOW_DROP           1     // drop new sessions
+#define OVERFLOW_STOP           2     // stop the tag
+#define OVERFLOW_POLICY         OVERFLOW_DROP
 #define SHUTDOWN_TIMEOUT_MS     300000 //shutdown after 5 mins after stopping
 
 // PING radio parameters
@@ -64,9 +77,19 @@
 // how long to listen for a nearby reader -> battery drain if long
 #define READER_DURATION   20
 
+// After answering a reader, listen on the download channel this long for
+// a command. A reader busy downloading another tag sets the busy field
+// of its pings, CMD_PING = [CMD_PING, reader id(2), 0, busy]. Answer it
+// once with [CMD_PING, tag id(2), PING_WAITING] so the reader queues the
+// tag, and listen for the reader again in busy * READER_BUSY_MS, plus up
+// to a quarter more so the tags it turned away don't all come back at
+// once.
+#define DOWNLOAD_WINDOW_MS  100
+#define READER_BUSY_MS      100
+#define PING_WAITING        0x02
+
 // start address of tag data structures in EEPROM
 #define EEPROM_DATA_START 0x04
-#define EEPROM_SIZE       0xFFFF  // last address in EEPROM
 #define CHECK_BYTE1       0xBE
 #define CHECK_BYTE2       0xEF
 
@@ -82,6 +105,63 @@
 #define PKT_DATA          0xA9  // this is a data packet
 #define CMD_WRITE_SETTING 0xAA  // configure device EEPROM metadata
 #define CMD_READ_SETTINGS 0xAB
+#define PKT_INDEX         0xAC  // record count etc. sent ahead of the data
+#define PKT_BULK          0xAD  // several records, numbered for retransmit
+#define PKT_WINDOW        0xAE  // end of a window of PKT_BULK, ack it
+#define CMD_WINDOW_ACK    0xAF  // bitmap of the PKT_BULK of a window received
+#define PKT_PACKED        0xB0  // PKT_BULK with packed records
+#define PKT_DICT          0xB1  // peer dictionary, packet 0 of a packed upload
+#define CMD_BROADCAST     0xB2  // a command for the tags in a bitmap
+#define CMD_INVENTORY     0xB3  // slot beacon of an inventory
+#define PKT_INVENTORY     0xB4  // a tag's reply in its inventory slot
+
+// Download options, the byte after the tag id of a download command
+#define DL_OPT_BULK       0x01  // send PKT_BULK rather than PKT_DATA
+#define DL_OPT_FAST       0x02  // switch to the download profile after PKT_INDEX
+#define DL_OPT_NEW        0x04  // only records the tag has not had acked yet
+#define DL_OPT_SINCE      0x08  // records from the sequence number(4) that follows
+#define DL_OPT_RUN        0x10  // keep the tag running after the download
+#define DL_OPT_PACK       0x20  // with DL_OPT_BULK, send PKT_PACKED
+
+// PKT_BULK = [PKT_BULK, seq(2), count, now(4)] and count records of
+// [tagid(2), first seen(4), duration(2)]. Times are seconds since the
+// tag started. Windows start at multiples of BULK_WINDOW packets.
+#define BULK_HEADER_LEN   8
+#define BULK_RECORD_LEN   8
+#define BULK_RECORDS      3     // records per PKT_BULK, fills 32 bytes
+#define BULK_WINDOW       8     // PKT_BULK per window, a power of 2 <= 8
+
+// PKT_PACKED has the PKT_BULK header and count packed records of
+//   peer      index of the tag id in the dictionary, or PACK_LITERAL
+//             followed by the tag id(2)
+//   first     first seen, zigzag varint of the difference to the record
+//             before it in the packet (to 0 for the first one)
+//   duration  varint
+// Varints hold 7 bits per byte, low bits first, with the high bit set
+// on all but the last byte. PKT_DICT has the PKT_BULK header and count
+// tag ids(2), the peers seen most in the upload.
+#define PACK_DICT_SIZE    8
+#define PACK_LITERAL      0xFF
+#define PACK_RECORD_MAX   11    // peer(3), first(5), duration(3)
+
+// CMD_BROADCAST = [CMD_BROADCAST, base tag id(2), command, data(4)] and
+// a bitmap of the tags base to base + BROADCAST_TAGS - 1 it is for, low
+// bit first. Sent on the reader channel, tags run it like the command
+// sent to them (START, STOP or WRITE_SETTING) and ack in a random one of
+// BROADCAST_SLOTS slots after it.
+#define BROADCAST_HEADER_LEN  8
+#define BROADCAST_DATA_LEN    4
+#define BROADCAST_TAGS        192   // bitmap fills 32 bytes
+#define BROADCAST_SLOTS       4
+#define BROADCAST_SLOT_MS     3
+
+// CMD_INVENTORY = [CMD_INVENTORY, round(2), Q, frame, acked tag id(2)]
+// starts each slot of a frame of 2^Q slots. A tag picks a random slot of
+// the frame and replies PKT_INVENTORY = [PKT_INVENTORY, tagid(2),
+// round(2)] in it. The next beacon acks the reply, and the tag keeps
+// quiet for the rest of the round. Frames with a new number restart the
+// slot count.
+#define INVENTORY_MAX_Q       7
 
 #define SET_PING_TX_RANGE       0
 #define SET_PING_CHANNEL        1
@@ -92,6 +172,7 @@
 #define SET_READER_PERIOD_S     6
 #define SET_SESSION_TIMEOUT_S   7
 #define SET_DEFAULTS            8 // reset settings to default
+#define SET_OVERFLOW_POLICY     9
 
 // *******************  Utility macros
 #define IS_LOCATOR(tagid) (tagid > MAX_TAG_ID) 
@@ -103,8 +184,8 @@
     #define PRINT Serial.print
     #define PRINTLN Serial.println
 #else
-    #define PRINT //Serial.print
-    #define PRINTLN //Serial.println
+    #define PRINT(...)
+    #define PRINTLN(...)
 #endif
 
 // ****** Common Structs
@@ -119,6 +200,7 @@ struct MetaData {
   unsigned int listenPeriodSecs;
   unsigned int readerPeriodSecs;
   unsigned int sessionTimeoutSecs;
+  byte overflowPolicy; // OVERFLOW_OVERWRITE, OVERFLOW_DROP or OVERFLOW_STOP
 };
 
 #endif
@@ -10,79 +10,167 @@
 
 // Main entities
 RF24 radio(P2_0, P2_1); // P2.0=CE, P2.1=CSN
+#define RADIO_IRQ P2_2 // active low when the radio has received a packet
 //Enrf24 radio(P2_0, P2_1, P2_2);  // P2.0=CE, P2.1=CSN, P2.2=IRQ
 Eeprom eeprom;
 Protocol protocol;
 
+// how often to come back while staged sessions are written to EEPROM
+#define STORAGE_POLL_MS 5
+
 // state variables
 unsigned int tagid = 0;
-unsigned long lastPing = 0;
-unsigned long lastListen = 0;
-unsigned long listenDuration = 0;
-unsigned long readerListen = 0;
-unsigned long readerDuration = 0;
-unsigned long lastStopped  = 0;
-
-// Power down and sleep for just under the specified time
-void deepSleep(unsigned long time) {
-  if (time >= PING_PERIOD_MS) {
-    // should not sleep longer than ping period
-    time = PING_PERIOD_MS - 10;
+volatile boolean suspended = false;
+volatile boolean radioIrq = false;
+
+// Deadline scheduler for the main loop: every activity has the millis()
+// time it is next due. loop() runs what is due, then sleeps until the
+// earliest deadline, so an idle activity costs nothing.
+enum {
+  EV_PING, // send a ping
+  EV_LISTEN, // listen window for pings of other tags
+  EV_READER, // listen window for readers
+  EV_EXPIRY, // a RAM session times out
+  EV_STORAGE, // staged sessions wait for the EEPROM
+  EV_AUTO_STOP, // wearables stop after AUTO_STOP_SECONDS
+  EV_SHUTDOWN, // stopped for SHUTDOWN_TIMEOUT_MS
+  EV_COUNT
+};
+unsigned long eventDue[EV_COUNT];
+unsigned int eventArmed = 0; // bit per event
+
+void schedule(byte event, unsigned long inMs) {
+  eventDue[event] = millis() + inMs;
+  eventArmed |= 1 << event;
+}
+
+void cancel(byte event) {
+  eventArmed &= ~(1 << event);
+}
+
+boolean isArmed(byte event) {
+  return (eventArmed & (1 << event)) != 0;
+}
+
+boolean isDue(byte event) {
+  return isArmed(event) && (long)(millis() - eventDue[event]) >= 0;
+}
+
+// time until an event is due, 0 if it is due already
+unsigned long msUntil(byte event, unsigned long now) {
+  if (!isArmed(event)) return 0xFFFFFFFF;
+  long left = (long)(eventDue[event] - now);
+  return left > 0 ? left : 0;
+}
+
+// time until the earliest deadline, 0 if something is due already
+unsigned long msToNextEvent() {
+  unsigned long now = millis();
+  unsigned long next = 0xFFFFFFFF;
+  for (byte e = 0; e < EV_COUNT; e++) {
+    next = min(next, msUntil(e, now));
   }
-  radio.powerDown();
+  return next;
+}
+
+// schedule, or cancel, a deadline that the protocol keeps track of
+void scheduleIn(byte event, unsigned long inMs) {
+  if (inMs == 0xFFFFFFFF) {
+    cancel(event);
+  } else {
+    schedule(event, inMs);
+  }
+}
 
-  if (time > 10) {
-    sleep(time - 10); // adjustment for wakeup time, etc.
+// Bring the deadlines that follow the protocol state up to date. START
+// and STOP commands arrive while listening, so this runs every pass.
+void scheduleProtocolEvents() {
+  if (protocol.isStopped) {
+    cancel(EV_PING);
+    cancel(EV_LISTEN);
+    if (!isArmed(EV_SHUTDOWN)) schedule(EV_SHUTDOWN, SHUTDOWN_TIMEOUT_MS);
   } else {
-    sleep(time);
+    if (!isArmed(EV_PING)) schedule(EV_PING, 0);
+    if (!isArmed(EV_LISTEN) && !IS_LOCATOR(tagid)) schedule(EV_LISTEN, 0);
+    cancel(EV_SHUTDOWN);
+  }
+
+  scheduleIn(EV_EXPIRY, protocol.msToNextExpiry());
+  scheduleIn(EV_AUTO_STOP, protocol.msToAutoStop());
+  scheduleIn(EV_STORAGE, protocol.storagePending() ? STORAGE_POLL_MS : 0xFFFFFFFF);
+}
+
+void radioInterrupt() {
+  radioIrq = true;
+  wakeup(); // end sleep() early
+}
+
+// Sleep with the radio listening, until it raises its IRQ line for a
+// received packet or ms have passed. True if a packet is waiting.
+boolean waitForRadio(unsigned long ms) {
+  if (!radioIrq && ms > 0) sleep(ms);
+
+  // the line stays low while the RX_DR flag is set, which also catches
+  // an interrupt that came in just before sleep()
+  boolean received = radioIrq || digitalRead(RADIO_IRQ) == LOW;
+  radioIrq = false;
+  return received;
+}
+
+// read and handle everything in the radio's RX FIFO
+void processReceived() {
+  while (protocol.radioRead() > 0) {
+    protocol.process(protocol.packet, protocol.packetLen);
   }
 }
 
+// Power down and sleep for the specified time
+void deepSleep(unsigned long time) {
+  radio.powerDown();
+  sleep(time);
+}
+
 #ifdef SHUTDOWN_TIMEOUT_MS
 void interruptTag() {
-    if (lastStopped == 0) return; // avoid multiple interrupt triggers
-    lastStopped = 0;
+    if (!suspended) return; // avoid multiple interrupt triggers
+    suspended = false;
 
     //wake tag up when interrupted
     wakeup();
 }
 
 void shutdownTag() {
-  if (!protocol.isStopped) return; 
-
   //if the tag is stopped, shutdown after timeout
-  if (lastStopped == 0) {
-    //start the timer for shutdown timeout
-    lastStopped = millis();
-  } else {
-    if (millis() - lastStopped > SHUTDOWN_TIMEOUT_MS) {
-      //shutdown timeout has occured so shutdown tag
-      PRINTLN("Shutting down to save power...");
+  if (!isDue(EV_SHUTDOWN)) return;
+  cancel(EV_SHUTDOWN);
 
-      //set up interrupt pin
-      pinMode(P2_3, INPUT_PULLDOWN); // pin with reed switch attached
-      attachInterrupt(P2_3, interruptTag, RISING);
+  //shutdown timeout has occured so shutdown tag
+  PRINTLN("Shutting down to save power...");
 
-      // shutdown hardware and then the MCU
-      radio.stopListening();
-      radio.powerDown();
-      digitalWrite(LED, LOW);
-      suspend();
+  //set up interrupt pin
+  pinMode(P2_3, INPUT_PULLDOWN); // pin with reed switch attached
+  attachInterrupt(P2_3, interruptTag, RISING);
 
-      detachInterrupt(P2_3);
-      PRINTLN("Waking up...");
-      digitalWrite(LED, HIGH);
-      sleep(500);
-      digitalWrite(LED, LOW);
-    }
-  }
+  // shutdown hardware and then the MCU
+  radio.stopListening();
+  radio.powerDown();
+  digitalWrite(LED, LOW);
+  suspended = true;
+  suspend();
+
+  detachInterrupt(P2_3);
+  PRINTLN("Waking up...");
+  digitalWrite(LED, HIGH);
+  sleep(500);
+  digitalWrite(LED, LOW);
 }
 #endif
 
 unsigned int readTagId() {
     unsigned long timer = millis();
     boolean on = false;
-    char intBuffer[6], index=0;
+    char intBuffer[6];
+    byte index = 0;
     int delimiter = (int) '\n';
     int ch;
     while ((ch = Serial.read()) != delimiter) {
@@ -111,8 +199,8 @@ unsigned int readTagId() {
 boolean sendPing() {
   if (protocol.isStopped) return false;
 
-  if (TIME_INTERVAL(lastPing) >= (protocol.metaData.pingPeriodMs - 10)) {
-    lastPing = millis();
+  if (isDue(EV_PING)) {
+    schedule(EV_PING, protocol.metaData.pingPeriodMs - 10);
   
     protocol.setTXPower();
     byte pingStrong = ((protocol.metaData.pingTxRange & 0b10000000) > 0 ? 1 : 0);
@@ -140,8 +228,9 @@ boolean sendPing() {
 void listenForPings() {
   if (protocol.isStopped) return;
 
-  if (TIME_INTERVAL(lastListen) >= (protocol.metaData.listenPeriodSecs * 1000)) {
-    lastListen = millis();    
+  if (isDue(EV_LISTEN)) {
+    schedule(EV_LISTEN, protocol.metaData.listenPeriodSecs * 1000UL);
+    radio.powerUp();
     radio.startListening();
 
     #ifdef DEBUG 
@@ -149,11 +238,14 @@ void listenForPings() {
       Serial.flush();
     #endif
 
-    listenDuration = millis();
-    while (TIME_INTERVAL(listenDuration) <= (protocol.metaData.pingPeriodMs + 10)) {
+    // sleep between packets, waking up to send our own pings
+    unsigned long window = protocol.metaData.pingPeriodMs + 10;
+    unsigned long elapsed;
+    unsigned long listenDuration = millis();
+    while ((elapsed = TIME_INTERVAL(listenDuration)) <= window) {
       // did we get something?
-      if (protocol.radioRead() > 0) {
-        protocol.process(protocol.packet, protocol.packetLen);
+      if (waitForRadio(min(window - elapsed + 1, msUntil(EV_PING, millis())))) {
+        processReceived();
       }
       digitalWrite(LED, LOW);
   
@@ -162,6 +254,7 @@ void listenForPings() {
       }
     }
 
+    processReceived(); // came in at the very end of the window
     radio.stopListening();
     radio.flush_rx();
     digitalWrite(LED, LOW);
@@ -169,22 +262,40 @@ void listenForPings() {
 }
 
 void listenForReaders() {
-  if (TIME_INTERVAL(readerListen) >= (protocol.metaData.readerPeriodSecs * 1000)) {
+  if (isDue(EV_READER)) {
     #ifdef DEBUG
       //tagid++; // uncomment for session load testing
       Serial.print("%");
       Serial.flush();
     #endif
 
-    readerListen = millis();
+    schedule(EV_READER, protocol.metaData.readerPeriodSecs * 1000UL);
     protocol.switchToReaderChannel();
 
-    readerDuration = millis();
-    while (TIME_INTERVAL(readerDuration) <= (unsigned long) READER_DURATION) {
-      radio.powerUp();
+    unsigned long elapsed;
+    radio.powerUp();
+    unsigned long readerDuration = millis();
+    while ((elapsed = TIME_INTERVAL(readerDuration)) <= (unsigned long) READER_DURATION) {
       // is a reader nearby?
-      if (protocol.radioRead() > 0) {
-        if (protocol.packet[0] == CMD_PING) {
+      if (waitForRadio(READER_DURATION - elapsed + 1) && protocol.radioRead() > 0) {
+        if (protocol.packet[0] == CMD_PING && protocol.packet[4] > 0) {
+          // the reader is busy with another tag, back when it is done
+          unsigned long busy = protocol.packet[4] * (unsigned long)READER_BUSY_MS;
+          busy += random(busy / 4 + 1);
+          if (busy < protocol.metaData.readerPeriodSecs * 1000UL) {
+            schedule(EV_READER, busy);
+          }
+          radio.flush_rx();
+
+          // one ping so the reader queues us, no download window
+          protocol.packetLen = 0;
+          protocol.packet[protocol.packetLen++] = CMD_PING;
+          protocol.packet[protocol.packetLen++] = tagid >> 8;
+          protocol.packet[protocol.packetLen++] = tagid & 0xFF;
+          protocol.packet[protocol.packetLen++] = PING_WAITING;
+          protocol.radioWrite();
+          break;
+        } else if (protocol.packet[0] == CMD_PING) {
           while (protocol.radioRead() > 0) delay(1); // clear read buffer
 
           // let the reader know we're here by sending 
@@ -203,16 +314,21 @@ void listenForReaders() {
           radio.flush_rx();
           protocol.switchToDownloadChannel();
           unsigned long timer = millis();
-          while (TIME_INTERVAL(timer) <= 100) {
-            if (protocol.radioRead() > 0) {
-              protocol.process(protocol.packet, protocol.packetLen);
-            }
+          while ((elapsed = TIME_INTERVAL(timer)) <= DOWNLOAD_WINDOW_MS) {
+            if (waitForRadio(DOWNLOAD_WINDOW_MS - elapsed + 1)) processReceived();
           }
 
           #ifdef DEBUG
             Serial.print(")");
             Serial.flush();
           #endif
+        } else if (protocol.packet[0] == CMD_BROADCAST) {
+          protocol.process(protocol.packet, protocol.packetLen);
+        } else if (protocol.packet[0] == CMD_INVENTORY) {
+          // stay in the window while the inventory still wants a reply
+          if (protocol.handleInventory(protocol.packet, protocol.packetLen)) {
+            readerDuration = millis();
+          }
         }
       }
 
@@ -224,6 +340,13 @@ void listenForReaders() {
 }
 
 void testEeprom() {
+  // the check bytes of the tag id header tell the EEPROM geometry
+  byte checkBytes[] = { CHECK_BYTE1, CHECK_BYTE2 };
+  if (eeprom.detect(0x02, checkBytes, sizeof(checkBytes))) {
+    PRINT("EEPROM size: ");
+    PRINTLN(eeprom.size());
+  }
+
   tagid = eeprom.read(0x00) + (eeprom.read(0x01) << 8);
   byte check1 = eeprom.read(0x02);
   byte check2 = eeprom.read(0x03);
@@ -244,10 +367,8 @@ void testEeprom() {
     Serial.println("");
     Serial.print("Writing tag id ");
     Serial.println(tagid, DEC);
-    eeprom.write(0x00, tagid);
-    eeprom.write(0x01, tagid >> 8);
-    eeprom.write(0x02, CHECK_BYTE1);
-    eeprom.write(0x03, CHECK_BYTE2);
+    byte header[] = { (byte)(tagid & 0xFF), (byte)(tagid >> 8), CHECK_BYTE1, CHECK_BYTE2 };
+    eeprom.format(0x00, header, sizeof(header));
 
     protocol.resetMetaData();
     testEeprom();
@@ -282,6 +403,10 @@ void setup() {
   // setup protocol handler
   protocol.begin(tagid, &radio, &eeprom);
 
+  // wake up from listen windows on received packets
+  pinMode(RADIO_IRQ, INPUT_PULLUP);
+  attachInterrupt(RADIO_IRQ, radioInterrupt, FALLING);
+
   // By default, tags/locators are in STOP mode until started
   #ifdef DEBUG
   protocol.isStopped = false;
@@ -294,14 +419,18 @@ void setup() {
   #ifdef DEBUG
     Serial.print("Meta data size: ");
     Serial.println(sizeof(MetaData));
-    Serial.print("Tag data size: ");
-    Serial.println(sizeof(TagData));
+    Serial.print("Log record size: ");
+    Serial.println(sizeof(LogRecord));
   #endif
 
   #ifdef TEST_BED
     protocol.metaData.listenPeriodSecs = 10;
     protocol.metaData.sessionTimeoutSecs = 30;
   #endif
+
+  // everything is due straight away
+  schedule(EV_READER, 0);
+  scheduleProtocolEvents();
 }
 
 void loop() {
@@ -310,29 +439,22 @@ void loop() {
   }
 
   if (!IS_LOCATOR(tagid)) {
-    radio.powerUp();
     listenForPings();
-    protocol.tick();
+    if (isDue(EV_EXPIRY) || isDue(EV_AUTO_STOP) || isDue(EV_STORAGE)) {
+      protocol.tick();
+    }
   }
 
   listenForReaders();
 
-  // Power optimization: deep sleep until next event
-  unsigned long nextPing = TIME_INTERVAL2(lastPing + protocol.metaData.pingPeriodMs, millis());
-  unsigned long nextListen = TIME_INTERVAL2(lastListen + (protocol.metaData.listenPeriodSecs * 1000), millis());
-  unsigned long nextReader = TIME_INTERVAL2(readerListen + (protocol.metaData.readerPeriodSecs * 1000), millis());
+  // shutdown tag if stopped for a long time, to save battery
+  shutdownTag();
 
-  if (protocol.isStopped) {
-    // when stopped, keep listening for readers
-    deepSleep(nextReader);
-
-    // shutdown tag if stopped for a long time, to save battery
-    shutdownTag();
-  } else if (IS_LOCATOR(tagid)) {
-    // locators don't listen for tags
-    deepSleep(min(nextPing, nextReader));
-  } else {
-    // normal operation: sleep until next ping/listen/reader
-    deepSleep(min(nextPing, min(nextListen, nextReader)));
-  }
+  // start writing sessions that expired while awake, the EEPROM
+  // finishes the write cycle while we sleep
+  protocol.pollStorage();
+
+  // Power optimization: deep sleep until the next deadline
+  scheduleProtocolEvents();
+  deepSleep(msToNextEvent());
 }
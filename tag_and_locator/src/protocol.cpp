@@ -14,14 +14,32 @@ Protocol::Protocol() {
   noCommand = true;
   lastReset = 0;
   sessionStartSecs = 0;
-  d = TagData();
+  logCapacity = 0;
+  logBlocks = 0;
+  blockRecords = 0;
+  blockBase = 0;
+  tailSeq = 0;
+  stagedCount = 0;
+  stagedPartial = 0;
+  memset(spillTags, 0, sizeof(spillTags));
+  fastLink = false;
+  inventoryRound = 0;
+  inventoryFrame = 0;
+  inventorySlot = INVENTORY_ANY;
 }
 
+#ifdef __MSP430__
+  // sizes only hold for the 16-bit target
+  STATIC_ASSERT(sizeof(SessionLookup) == 6, session_lookup_size);
+  STATIC_ASSERT(sizeof(Protocol) <= PROTOCOL_RAM_BUDGET, protocol_fits_ram_budget);
+#endif
+
 // call in setup() to initialize
 void Protocol::begin(unsigned int _tagid, RF24 *_radio, Eeprom *_eep) {
   tagid = _tagid;
   eeprom = _eep;
   radio = _radio;
+  randomSeed(tagid); // broadcast ack slots differ between tags
 
   resetSessionData();
 
@@ -31,11 +49,30 @@ void Protocol::begin(unsigned int _tagid, RF24 *_radio, Eeprom *_eep) {
        metaData.sessionTimeoutSecs == 0 ||
        metaData.pingChannel != PING_CHANNEL ||
        metaData.downloadChannel != DOWNLOAD_CHANNEL ||
-       metaData.readerChannel != READER_CHANNEL) {
+       metaData.readerChannel != READER_CHANNEL ||
+       metaData.overflowPolicy > OVERFLOW_STOP) {
     Serial.println("Resetting metadata");
     resetMetaData();
   }
 
+  // size the session log for the detected EEPROM
+  if ((eeprom->size() - EEPROM_LOG_START) / EEPROM_PAGE_SIZE > MAX_LOG_BLOCKS) {
+    logCapacity = MAX_LOG_BLOCKS;
+  } else {
+    logCapacity = (eeprom->size() - EEPROM_LOG_START) / EEPROM_PAGE_SIZE;
+  }
+
+  // recover the end of the session log
+  readLogMeta();
+  if (logMeta.check != LOGMETA_CHECK) {
+    // unformatted log: wrap the generation so resetData() erases it
+    logMeta.generation = 0xFF;
+    logMeta.check = LOGMETA_CHECK;
+    resetData();
+  }
+  findWriteCursor();
+  countIndex();
+
   // set up NRF radio
   radio->begin();
   if (!radio->isChipConnected()) Serial.println("NRF not connected");
@@ -51,6 +88,7 @@ void Protocol::begin(unsigned int _tagid, RF24 *_radio, Eeprom *_eep) {
     radio->setAutoAck(false);
   #endif
   radio->setCRCLength(RF24_CRC_8); // 8-bit CRC
+  radio->maskIRQ(true, true, false); // IRQ line only for received packets
 }
 
 // regular house-keeping - should not execute for more than a few milliseconds!
@@ -59,36 +97,15 @@ void Protocol::tick() {
     loadTest();
   #endif
 
-  // check for expired sessions and write them out to EEPROM
-  for (int j=0; j < MAX_RAM_SESSIONS; j++) {
-    if (sessions[j].tagid > 0 && 
-          (secondsElapsed(sessions[j].lastSeenSeconds)) > metaData.sessionTimeoutSecs) {
-        // this session has expired, so write to EEPROM and remove from RAM
-        #ifdef DEBUG
-          PRINT("[");
-          PRINT(sessions[j].tagid);
-          PRINT("]-");
-        #endif
-
-        unsigned long startAddr = EEPROM_DATA_START + sizeof(MetaData);
-        for (i = startAddr; i < EEPROM_SIZE; i += sizeof(TagData)) {
-          readTagData(&d, i);
-          if (d.tagid > 0 && d.check == CHECK_BYTE) {
-            // this slot is occupied
-          } else {
-            // this slot is free
-            sessionToTagData(&sessions[j], &d);
-            writeTagData(i, &d); // write the tag data to EEPROM
-            break;
-          }
-        }
-
-        // NOTE: At this point, if EEPROM is full, data is lost
-        sessions[j].tagid = 0; // free this slot in RAM
-        sessions[j].lastSeenSeconds = 0;
-    }
+  // check for expired sessions and write them out to EEPROM. Nothing
+  // can expire before nextExpiry, so most ticks skip the table.
+  if (sessions.count > 0 &&
+      (int)((unsigned int)seconds() - nextExpiry) >= 0) {
+    expireSessions();
   }
 
+  pollStorage();
+
   // for new wearables with no off switch, do an auto-stop to save battery
   if (!IS_LOCATOR(tagid) && !isStopped && 
       TIME_INTERVAL2(seconds(), sessionStartSecs) > AUTO_STOP_SECONDS) {
@@ -96,9 +113,52 @@ void Protocol::tick() {
   }
 }
 
+// Stage the expired sessions and work out when the next one is due.
+// lastSeenSeconds only moves forward, so the deadline computed here
+// stays a lower bound until a new session is added.
+void Protocol::expireSessions() {
+  unsigned int now = seconds();
+  unsigned int timeout = sessionTimeout();
+  unsigned int untilDue = 0xFFFF;
+
+  for (byte j=0; j < sessions.count;) {
+    SessionLookup *s = &sessions.entries[j];
+    if (Sessions::age(s) > timeout) {
+      // this session has expired, so write to EEPROM and remove from RAM
+      #ifdef DEBUG
+        PRINT("[");
+        PRINT(s->tagid);
+        PRINT("]-");
+      #endif
+
+      // stage it for the next write to the log. If the staging buffer
+      // is still waiting on the EEPROM, keep the session in RAM for now
+      // and try again on the next tick.
+      if (stagedCount >= STAGED_SESSIONS) pollStorage();
+      if (stagedCount >= STAGED_SESSIONS) {
+        untilDue = 0;
+        break;
+      }
+      staged[stagedCount++] = *s;
+
+      // free it in RAM. The last session is moved into its place, so
+      // check the same entry again.
+      sessions.remove(j);
+      continue;
+    }
+
+    if (timeout + 1 - Sessions::age(s) < untilDue) {
+      untilDue = timeout + 1 - Sessions::age(s);
+    }
+    j++;
+  }
+
+  nextExpiry = now + untilDue;
+}
+
 int Protocol::radioRead() {
   if (radio->available()) {
-    packetLen = radio->getPayloadSize();
+    packetLen = fastLink ? radio->getDynamicPayloadSize() : radio->getPayloadSize();
     radio->read(packet, sizeof(packet));
     // Serial.print("< ");
     // for (i=0; i < 10; i++) {
@@ -112,9 +172,10 @@ int Protocol::radioRead() {
   return 0;
 }
 
-void Protocol::radioWrite() {
+// false if auto-ack is on and the packet was not acked
+boolean Protocol::radioWrite() {
   radio->stopListening();
-  radio->write(packet, packetLen);
+  boolean ok = radio->write(packet, packetLen);
   // if (packet[0] != CMD_PING) {
   //   Serial.print("> ");
   //   for (i=0; i < 10; i++) {
@@ -123,6 +184,7 @@ void Protocol::radioWrite() {
   //   }
   //   Serial.println();
   // }
+  return ok;
 }
 
 // process an incoming payload from a remote tag
@@ -134,26 +196,19 @@ void Protocol::process(byte* inbuf, int len) {
 
   if (inbuf[0] == CMD_PING) {
     handlePing(inbuf, len);
+  } else if (inbuf[0] == CMD_BROADCAST) {
+    handleBroadcast(inbuf, len);
   } else if (inbuf[0] == CMD_START && remoteTagId == tagid) {
     PRINTLN("> START");
     sendAckWithBatteryLevel();
-    if (isStopped) {
-      noCommand = false;
-      isStopped = false;
-      resetSessionData();
-      resetData();
-      sessionStartSecs = seconds();
-    }
+    startLogging();
   } else if (inbuf[0] == CMD_STOP && remoteTagId == tagid) {
     PRINTLN("> STOP");
     sendAck();
-    if (!isStopped) {
-      noCommand = false;
-      isStopped = true;
-    }
+    stopLogging();
   } else if (inbuf[0] == CMD_RESET && remoteTagId == tagid) {
     sendAck();
-    if (TIME_INTERVAL(lastReset) > 2000) {
+    if ((unsigned int)((unsigned int)millis() - lastReset) > 2000) {
       lastReset = millis();
       PRINTLN("> RESET");
       noCommand = false;
@@ -163,17 +218,18 @@ void Protocol::process(byte* inbuf, int len) {
   } else if (inbuf[0] == CMD_DOWNLOAD && remoteTagId == tagid) {
     PRINTLN("> DOWNLOAD");
     noCommand = false;
-    uploadData();
+    download(inbuf, len);
   } else if (inbuf[0] == CMD_DL_AND_RESET && remoteTagId == tagid) {
     PRINTLN("> DOWNLOAD_AND_RESET");
     noCommand = false;
-    uploadData();
+    download(inbuf, len);
   } else if (inbuf[0] == CMD_READ_SETTINGS && remoteTagId == tagid) {
     PRINTLN("> READ_SETTINGS");
     uploadSettings(inbuf, len);
   } else if (inbuf[0] == CMD_WRITE_SETTING && remoteTagId == tagid) {
     PRINTLN("> WRITE_SETTING");
     writeSetting(inbuf, len);
+    sendAck();
   } else {
     PRINT("> Unknown ");
     PRINTLN(inbuf[0], HEX);
@@ -186,10 +242,7 @@ void Protocol::clearBuffer() {
 
 void Protocol::resetSessionData() {
   // reset session data
-  for (int i=0; i < MAX_RAM_SESSIONS; i++) {
-    sessions[i].tagid = 0;
-    sessions[i].lastSeenSeconds = 0;
-  }
+  sessions.clear();
 }
 
 void Protocol::handlePing(byte* inbuf, int len) {
@@ -222,8 +275,101 @@ void Protocol::handlePing(byte* inbuf, int len) {
       return;
     }
 
-    d->lastSeenSeconds = seconds();
+    d->lastSeen = seconds();
+  }
+}
+
+// A command for the tags in the bitmap of a CMD_BROADCAST. Acks it in a
+// random slot so the tags that heard the broadcast don't all ack at once,
+// then runs it like the same command sent to this tag. The ack has no
+// battery level, reading it and writing settings take longer than the
+// reader listens. The reader repeats the broadcast until this tag's ack
+// takes it out of the bitmap.
+void Protocol::handleBroadcast(byte* inbuf, int len) {
+  unsigned int offset = tagid - getRemoteTagId(inbuf);
+  byte command = inbuf[3];
+
+  if (len < BROADCAST_HEADER_LEN + BROADCAST_TAGS / 8 || offset >= BROADCAST_TAGS) return;
+  if (!(inbuf[BROADCAST_HEADER_LEN + offset / 8] & (1 << (offset % 8)))) return;
+  if (command != CMD_START && command != CMD_STOP && command != CMD_WRITE_SETTING) return;
+
+  PRINTLN("> BROADCAST");
+  delay(random(BROADCAST_SLOTS) * BROADCAST_SLOT_MS);
+  sendAck();
+
+  if (command == CMD_START) {
+    startLogging();
+  } else if (command == CMD_STOP) {
+    stopLogging();
+  } else {
+    // same layout as the setting sent to this tag
+    memmove(inbuf + 3, inbuf + 4, BROADCAST_DATA_LEN);
+    writeSetting(inbuf, 3 + BROADCAST_DATA_LEN);
   }
+  radio->startListening(); // for the rest of the reader window
+}
+
+void Protocol::startLogging() {
+  if (isStopped) {
+    noCommand = false;
+    isStopped = false;
+    resetSessionData();
+    resetData();
+    sessionStartSecs = seconds();
+  }
+}
+
+void Protocol::stopLogging() {
+  if (!isStopped) {
+    noCommand = false;
+    isStopped = true;
+    flushStaged();
+  }
+}
+
+// A slot beacon of an inventory, see CMD_INVENTORY. Picks a random slot
+// of each new frame and replies in it, until a beacon acks the reply.
+// Returns true while the tag still takes part in the round.
+boolean Protocol::handleInventory(byte* inbuf, int len) {
+  if (len < 7) return false;
+
+  unsigned int round = ((unsigned int)inbuf[1] << 8) | inbuf[2];
+  byte q = inbuf[3] < INVENTORY_MAX_Q ? inbuf[3] : INVENTORY_MAX_Q;
+  byte frame = inbuf[4];
+  unsigned int acked = ((unsigned int)inbuf[5] << 8) | inbuf[6];
+
+  if (round == inventoryRound) return false;
+
+  if (inventorySlot == INVENTORY_REPLIED) {
+    if (acked == tagid) {
+      PRINTLN("> INVENTORY");
+      inventoryRound = round;
+      inventorySlot = INVENTORY_ANY;
+      return false;
+    }
+    // collided, try again in the next frame
+    inventorySlot = INVENTORY_WAIT;
+  }
+
+  if (frame != inventoryFrame || inventorySlot == INVENTORY_ANY) {
+    inventoryFrame = frame;
+    inventorySlot = random(1 << q);
+  } else if (inventorySlot != INVENTORY_WAIT) {
+    inventorySlot--;
+  }
+
+  if (inventorySlot == 0) {
+    packetLen = 0;
+    packet[packetLen++] = PKT_INVENTORY;
+    packet[packetLen++] = tagid >> 8;
+    packet[packetLen++] = tagid & 0xFF;
+    packet[packetLen++] = round >> 8;
+    packet[packetLen++] = round & 0xFF;
+    radioWrite();
+    radio->startListening(); // for the ack in the next beacon
+    inventorySlot = INVENTORY_REPLIED;
+  }
+  return true;
 }
 
 void Protocol::handleDownload(byte* inbuf, int len) {
@@ -241,7 +387,7 @@ void Protocol::handleDownload(byte* inbuf, int len) {
     if (radio->getDynamicPayloadSize() > 0) {
       unsigned int remoteTagId = getRemoteTagId(inbuf);
       if (inbuf[0] == CMD_DOWNLOAD && remoteTagId == tagid) {
-        uploadData();
+        download(inbuf, sizeof(inbuf));
         dataSent = true;
         break;
       }
@@ -259,52 +405,365 @@ unsigned int Protocol::getRemoteTagId(byte* inbuf) {
 
 // return the tag data for specified tag id
 SessionLookup* Protocol::getTagData(unsigned int tagId) {
-  SessionLookup *ret = NULL;
+  SessionLookup *s = sessions.find(tagId);
+  if (s != NULL) {
+    // we found an existing session in RAM
+    return s;
+  }
 
-  for (i=0; i < MAX_RAM_SESSIONS; i++) {
-    if (sessions[i].tagid == tagId) {
-      // we found an existing session in RAM
-      ret = &sessions[i];
-      break;
+  PRINT("+"); // indicate new session
+  if (sessions.full() && !spillSession()) {
+    // ERROR - we have run out of RAM!
+    PRINTLN("!OOM!");
+    return NULL; // ignore this tag
+  }
+
+  // it may expire before the sessions we already have
+  unsigned int due = (unsigned int)seconds() + sessionTimeout() + 1;
+  if (sessions.count == 0 || (int)(due - nextExpiry) < 0) nextExpiry = due;
+
+  // create a new session for this tag, or carry on a spilled one
+  s = sessions.insert(tagId);
+  s->start = TIME_INTERVAL2(seconds(), sessionStartSecs);
+  s->lastSeen = seconds();
+  if (TIME_INTERVAL2(seconds(), sessionStartSecs) > 0xFFFF) {
+    s->start = 0xFFFF; // running for longer than expected
+  }
+  resumeSession(s);
+  return s;
+}
+
+// Make room in a full session table: checkpoint the least recently seen
+// session to the log as a partial record, which is resumed if the peer
+// shows up again before the session timeout.
+boolean Protocol::spillSession() {
+  if (stagedCount >= STAGED_SESSIONS) pollStorage();
+  if (stagedCount >= STAGED_SESSIONS) return false;
+
+  byte lru = sessions.oldest();
+
+  #ifdef DEBUG
+    PRINT("<");
+    PRINT(sessions.entries[lru].tagid);
+    PRINT(">");
+  #endif
+
+  stagedPartial |= 1 << stagedCount;
+  staged[stagedCount++] = sessions.entries[lru];
+  sessions.remove(lru);
+  return true;
+}
+
+// Look for a partial record of a new session's peer, spilled no longer
+// than the session timeout ago, and carry the session on from it. The
+// staging buffer is searched, then the spill index for the log.
+boolean Protocol::resumeSession(SessionLookup *s) {
+  // not written to EEPROM yet, take it back out of the staging buffer
+  for (byte j = stagedCount; j-- > 0;) {
+    if (staged[j].tagid == s->tagid && (stagedPartial & (1 << j)) &&
+        Sessions::age(&staged[j]) <= sessionTimeout()) {
+      s->start = staged[j].start;
+      stagedCount--;
+      memmove(staged + j, staged + j + 1, (stagedCount - j) * sizeof(SessionLookup));
+      stagedPartial = (stagedPartial & ((1 << j) - 1)) |
+          ((stagedPartial >> 1) & ~((1 << j) - 1));
+      return true;
     }
   }
 
-  if (ret == NULL) {
-    PRINT("+"); // indicate new session
-    // create a new session for this tag
-    i = 0;
-    while (sessions[i].tagid != 0 && i <= MAX_RAM_SESSIONS) i++;
-    if (i >= MAX_RAM_SESSIONS) {
-      // ERROR - we have run out of RAM!
-      PRINTLN("!OOM!");
-      return NULL; // ignore this tag
+  for (byte j = 0; j < SPILL_INDEX; j++) {
+    if (spillTags[j] == s->tagid) {
+      spillTags[j] = 0; // resumed or stale, either way done with
+      return resumeRecord(s, spillSeqs[j]);
     }
+  }
 
-    sessions[i].tagid = tagId;
-    sessions[i].firstSeenSeconds = seconds();
-    sessions[i].lastSeenSeconds = seconds();
-    ret = &sessions[i];
+  // In a crowd, it may have dropped out of the index. Look in the block
+  // being filled too, while sessions are still being spilled.
+  if (!sessions.full() || logBlocks == 0) return false;
+  LogRecord r;
+  for (byte j = blockRecords; j-- > 0;) {
+    readRecord(logBlocks - 1, j, &r);
+    if (r.tagid == s->tagid) {
+      return resumeRecord(s, (unsigned int)(tailSeq + logBlocks - 1) * RECORDS_PER_BLOCK + j);
+    }
   }
 
-  return ret;
+  return false;
 }
 
-void Protocol::readTagData(TagData *tagData, unsigned long addr) {
-  // read data from eeprom
-  for (int i = 0; i < TAGDATA_SIZE; i++) {
-    byte b = eeprom->read(addr + i);
-    *((byte *)tagData + i) = b;
+// Resume a session from its partial record in the log, and void the
+// record. seq holds the low 16 bits of the record's sequence number,
+// which is no more than a session timeout old.
+boolean Protocol::resumeRecord(SessionLookup *s, unsigned int seq) {
+  BlockHeader header;
+  LogRecord r;
+  TagData partial;
+
+  if (logBlocks == 0) return false;
+
+  // the whole sequence number, counting back from the end of the log
+  unsigned long end = (unsigned long)(unsigned int)(tailSeq + logBlocks - 1) *
+      RECORDS_PER_BLOCK + blockRecords;
+  unsigned long position = recordPosition(end - (unsigned int)((unsigned int)end - seq));
+  unsigned int block = position / RECORDS_PER_BLOCK;
+  byte record = position % RECORDS_PER_BLOCK;
+
+  // the block may have been overwritten since
+  if (block >= logBlocks || !readBlockHeader(block, &header)) return false;
+  readRecord(block, record, &r);
+  if (r.tagid != s->tagid || (r.end & RECORD_FLAGS_MASK) != RECORD_PARTIAL) {
+    return false;
+  }
+
+  decodeRecord(&header, &r, &partial);
+  if (seconds() - partial.lastSeenSeconds > sessionTimeout() ||
+      partial.firstSeenSeconds < sessionStartSecs) {
+    return false;
+  }
+
+  r.end |= RECORD_VOID;
+  eeprom->startWrite(recordAddr(block, record) + sizeof(r.tagid),
+      (byte *)&r.end, sizeof(r.end));
+  logMeta.records--;
+  logMeta.checksum -= r.tagid + r.duration;
+
+  s->start = partial.firstSeenSeconds - sessionStartSecs;
+  return true;
+}
+
+// remember where the partial record of a spilled session went, the
+// oldest entry makes room
+void Protocol::indexSpill(unsigned int tagId, unsigned long seq) {
+  memmove(spillTags + 1, spillTags, (SPILL_INDEX - 1) * sizeof(spillTags[0]));
+  memmove(spillSeqs + 1, spillSeqs, (SPILL_INDEX - 1) * sizeof(spillSeqs[0]));
+  spillTags[0] = tagId;
+  spillSeqs[0] = seq;
+}
+
+// EEPROM address of a log block, counting from the oldest block. The
+// log is a ring, so the block after the last physical one is the first.
+unsigned long Protocol::blockAddr(unsigned int block) {
+  block = (logMeta.tail + block) % logCapacity;
+  return EEPROM_LOG_START + (unsigned long)block * EEPROM_PAGE_SIZE;
+}
+
+// EEPROM address of a record slot in a log block
+unsigned long Protocol::recordAddr(unsigned int block, byte record) {
+  return blockAddr(block) + sizeof(BlockHeader) + record * sizeof(LogRecord);
+}
+
+// read a block header, returns true if the block belongs to the log
+boolean Protocol::readBlockHeader(unsigned int block, BlockHeader *header) {
+  eeprom->readBlock(blockAddr(block), (byte *)header, sizeof(BlockHeader));
+  return header->check == BLOCK_CHECK &&
+      header->generation == logMeta.generation &&
+      header->seq == (unsigned int)(tailSeq + block);
+}
+
+void Protocol::readRecord(unsigned int block, byte record, LogRecord *r) {
+  eeprom->readBlock(recordAddr(block, record), (byte *)r, sizeof(LogRecord));
+}
+
+// does a record with this last seen time fit into the last block?
+boolean Protocol::fitsBlock(unsigned long lastSeenSeconds) {
+  return lastSeenSeconds >= blockBase &&
+      lastSeenSeconds - blockBase <= RECORD_OFFSET_MASK;
+}
+
+// Start writing staged sessions to the log without waiting for the
+// EEPROM. Records that go into the same block are sent as one page
+// write; any that don't fit stay staged for the next call.
+void Protocol::writeStaged() {
+  struct {
+    BlockHeader header;
+    LogRecord records[STAGED_SESSIONS];
+  } page;
+  byte n = 0;
+  boolean newBlock;
+  TagData d;
+
+  if (stagedCount == 0) return;
+
+  sessionToTagData(&staged[0], &d);
+  newBlock = logBlocks == 0 || blockRecords >= RECORDS_PER_BLOCK ||
+      !fitsBlock(d.lastSeenSeconds);
+  if (newBlock) {
+    if (logBlocks >= logCapacity && !handleOverflow()) return;
+
+    // start a new block based on this record
+    page.header.check = BLOCK_CHECK;
+    page.header.generation = logMeta.generation;
+    page.header.seq = tailSeq + logBlocks;
+    page.header.baseSeconds = 0;
+    if (d.lastSeenSeconds > BLOCK_BASE_SLACK) {
+      page.header.baseSeconds = d.lastSeenSeconds - BLOCK_BASE_SLACK;
+    }
+    blockBase = page.header.baseSeconds;
+    blockRecords = 0;
+    logBlocks++;
+  }
+
+  // collect the run of records that fit into this block
+  while (n < stagedCount && blockRecords + n < RECORDS_PER_BLOCK) {
+    sessionToTagData(&staged[n], &d);
+    if (!fitsBlock(d.lastSeenSeconds)) break;
+    page.records[n].tagid = d.tagid;
+    page.records[n].end = d.lastSeenSeconds - blockBase;
+    if (stagedPartial & (1 << n)) {
+      page.records[n].end |= RECORD_PARTIAL;
+      indexSpill(d.tagid, (unsigned long)(unsigned int)(tailSeq + logBlocks - 1) *
+          RECORDS_PER_BLOCK + blockRecords + n);
+    }
+    page.records[n].duration = d.lastSeenSeconds - d.firstSeenSeconds;
+    addToIndex(&d);
+    n++;
+  }
+
+  if (newBlock) {
+    // zero the rest of the page in the same write cycle, so stale
+    // records from older generations read as free slots
+    eeprom->startWrite(blockAddr(logBlocks - 1),
+        (byte *)&page, sizeof(BlockHeader) + n * sizeof(LogRecord),
+        EEPROM_PAGE_SIZE - sizeof(BlockHeader) - n * sizeof(LogRecord));
+  } else {
+    eeprom->startWrite(recordAddr(logBlocks - 1, blockRecords),
+        (byte *)page.records, n * sizeof(LogRecord));
+  }
+  blockRecords += n;
+
+  // drop the written records from the staging buffer
+  stagedCount -= n;
+  memmove(staged, staged + n, stagedCount * sizeof(SessionLookup));
+  stagedPartial >>= n;
+}
+
+// The log is full, apply the overflow policy. Returns true if the oldest
+// block was retired to make room for a new one.
+boolean Protocol::handleOverflow() {
+  BlockHeader header;
+  LogRecord r;
+  TagData first;
+
+  if (metaData.overflowPolicy == OVERFLOW_OVERWRITE) {
+    // take the records of the oldest block out of the index
+    readBlockHeader(0, &header);
+    for (byte j = 0; j < RECORDS_PER_BLOCK; j++) {
+      readRecord(0, j, &r);
+      if (r.tagid == 0) break;
+      if (r.end & RECORD_VOID) continue; // not counted any more
+      logMeta.dropped++;
+      logMeta.records--;
+      logMeta.checksum -= r.tagid + r.duration;
+    }
+    logMeta.tail = (logMeta.tail + 1) % logCapacity;
+    tailSeq++;
+    logBlocks--;
+
+    // the log now starts (roughly) with the first record of the next block
+    readBlockHeader(0, &header);
+    readRecord(0, 0, &r);
+    decodeRecord(&header, &r, &first);
+    logMeta.firstSeconds = first.firstSeenSeconds;
+
+    // persist the new tail before its block is overwritten
+    writeLogMeta();
+    return true;
+  }
+
+  // drop the new sessions
+  logMeta.dropped += stagedCount;
+  stagedCount = 0;
+  stagedPartial = 0;
+  if (metaData.overflowPolicy == OVERFLOW_STOP) {
+    isStopped = true;
+  }
+  writeLogMeta();
+  return false;
+}
+
+// Count the log index from the records, at boot. It changes with every
+// record written, so it is not kept up to date in EEPROM.
+void Protocol::countIndex() {
+  UploadCursor c = UploadCursor();
+  TagData d;
+
+  logMeta.records = 0;
+  logMeta.checksum = 0;
+  while (nextRecord(&c, &d)) addToIndex(&d);
+}
+
+// account for a record appended to the log in the log index
+void Protocol::addToIndex(TagData *tagData) {
+  if (logMeta.records == 0 ||
+      tagData->firstSeenSeconds < logMeta.firstSeconds) {
+    logMeta.firstSeconds = tagData->firstSeenSeconds;
+  }
+  if (logMeta.records == 0 ||
+      tagData->lastSeenSeconds > logMeta.lastSeconds) {
+    logMeta.lastSeconds = tagData->lastSeenSeconds;
+  }
+  logMeta.records++;
+  logMeta.checksum += tagData->tagid +
+      (unsigned int)(tagData->lastSeenSeconds - tagData->firstSeenSeconds);
+}
+
+// Start the next staged write if the EEPROM is idle. Called from the
+// main loop, so writes never hold up listening for pings.
+void Protocol::pollStorage() {
+  if (stagedCount > 0 && eeprom->ready()) {
+    writeStaged();
   }
 }
 
-// write modified tag data back into eeprom
-void Protocol::writeTagData(unsigned long addr, TagData *data) {
-  byte* bytes = reinterpret_cast<byte*>(data);
-  for (int i = 0; i < TAGDATA_SIZE; i++) {
-    byte b = bytes[i];
-    byte d = eeprom->read(addr + i);
-    if (b != d) {
-      eeprom->write(addr + i, b);
+// write all staged sessions and wait until they are in EEPROM
+void Protocol::flushStaged() {
+  while (stagedCount > 0) {
+    writeStaged();
+  }
+  eeprom->waitReady();
+}
+
+// Blocks are only ever appended at the head of the ring, so starting
+// from the tail the log is a run of blocks with consecutive sequence
+// numbers, followed by free space or blocks of older generations.
+// Binary search for that boundary so recovering the write cursor at
+// boot takes O(log N) reads instead of a full scan.
+void Protocol::findWriteCursor() {
+  BlockHeader header;
+  LogRecord r;
+  unsigned int lo = 0;
+  unsigned int hi = logCapacity; // the first free block is in [lo, hi]
+  unsigned int mid;
+
+  // the tail block holds the lowest sequence number
+  logBlocks = 0;
+  blockRecords = 0;
+  tailSeq = 0;
+  eeprom->readBlock(blockAddr(0), (byte *)&header, sizeof(BlockHeader));
+  if (header.check != BLOCK_CHECK || header.generation != logMeta.generation) {
+    return; // empty log
+  }
+  tailSeq = header.seq;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (readBlockHeader(mid, &header)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  logBlocks = lo;
+  if (logBlocks > 0) {
+    // count the records in the last block
+    readBlockHeader(logBlocks - 1, &header);
+    blockBase = header.baseSeconds;
+    while (blockRecords < RECORDS_PER_BLOCK) {
+      readRecord(logBlocks - 1, blockRecords, &r);
+      if (r.tagid == 0) break;
+      blockRecords++;
     }
   }
 }
@@ -347,6 +806,11 @@ void Protocol::uploadSettings(byte* inbuf, int len) {
   packet[j++] = metaData.readerPeriodSecs >> 8;
   packet[j++] = metaData.sessionTimeoutSecs & 0xFF;
   packet[j++] = metaData.sessionTimeoutSecs >> 8;
+  packet[j++] = metaData.overflowPolicy;
+  packet[j++] = logMeta.dropped >> 24;
+  packet[j++] = logMeta.dropped >> 16;
+  packet[j++] = logMeta.dropped >> 8;
+  packet[j++] = logMeta.dropped;
   packetLen = j;
   radioWrite();
 
@@ -395,6 +859,14 @@ void Protocol::writeSetting(byte* inbuf, int len) {
       PRINT("Session timeout sec = ");
       metaData.sessionTimeoutSecs = (inbuf[4] << 8) + inbuf[5];
       PRINTLN(metaData.sessionTimeoutSecs);
+      nextExpiry = seconds(); // deadlines changed, rescan on the next tick
+      break;
+    case SET_OVERFLOW_POLICY:
+      PRINT("Overflow policy = ");
+      if (inbuf[4] <= OVERFLOW_STOP) {
+        metaData.overflowPolicy = inbuf[4];
+      }
+      PRINTLN(metaData.overflowPolicy);
       break;
     case SET_DEFAULTS:
       PRINT("Resetting metadata to defaults");
@@ -405,41 +877,493 @@ void Protocol::writeSetting(byte* inbuf, int len) {
   }
 
   writeMetaData();
-  sendAck();
 }
 
-void Protocol::uploadData() {
-  // upload the data stored in EEPROM (saved sessions)
-  unsigned int startAddr = EEPROM_DATA_START + sizeof(MetaData);
-  for (i = startAddr; i < EEPROM_SIZE; i += sizeof(TagData)) {
-    readTagData(&d, i);
-    if (d.tagid > 0 && d.check == CHECK_BYTE) {
-      uploadTagData(&d);
-    } else {
-      break;
-    }
+// Run a download command. The options after the tag id pick the
+// upload format and where in the log to start.
+void Protocol::download(byte *inbuf, int len) {
+  byte options = len > 3 ? inbuf[3] : 0;
+  unsigned long since = 0;
+
+  if ((options & DL_OPT_SINCE) && len > 7) {
+    since = ((unsigned long)inbuf[4] << 24) | ((unsigned long)inbuf[5] << 16) |
+        ((unsigned int)inbuf[6] << 8) | inbuf[7];
+  } else if (options & DL_OPT_NEW) {
+    since = logMeta.uploaded;
   }
 
-  // upload data in RAM (current sessions)
-  for (i=0; i < MAX_RAM_SESSIONS; i++) {
-    if (sessions[i].tagid > 0) {
-      sessionToTagData(&sessions[i], &d);
+  // only reset once the reader has acked every record
+  if (uploadData(options, since) && inbuf[0] == CMD_DL_AND_RESET) {
+    resetData();
+  }
+}
+
+// Upload the saved sessions in EEPROM from record sequence number
+// since, then the current ones in RAM. options are DL_OPT_* flags from
+// the download command. Returns true if the reader acked all records,
+// which only bulk uploads tell.
+boolean Protocol::uploadData(byte options, unsigned long since) {
+  UploadCursor c = UploadCursor();
+  TagData d;
+  PeerDict dict;
+  PeerDict *peers = NULL; // packed uploads only
+  byte accepted = options & (DL_OPT_BULK | DL_OPT_FAST | DL_OPT_PACK);
+  boolean complete = false;
+
+  // staged sessions go to EEPROM first, so they are sent in log order
+  flushStaged();
+  seekRecord(&c, since);
+
+  if (!(accepted & DL_OPT_BULK)) accepted &= ~DL_OPT_PACK;
+  if (accepted & DL_OPT_PACK) {
+    memset(&dict, 0, sizeof(dict));
+    peers = &dict;
+  }
+
+  // tell the reader what to expect, and which options are on. The
+  // reader goes to the download profile as soon as it has the index,
+  // so follow it only once the index is acked.
+  if (uploadIndex(&c, accepted, peers) && (accepted & DL_OPT_FAST)) {
+    setFastLink(true);
+  }
+
+  if (accepted & DL_OPT_BULK) {
+    unsigned int base = 0;
+    unsigned long uploaded = logMeta.uploaded;
+    byte sent;
+    while ((sent = uploadWindow(&c, base, peers)) > 0) {
+      base += sent;
+      // what the reader acked, a later download can start from here
+      if (recordPosition(recordSeq(&c)) > recordPosition(logMeta.uploaded)) {
+        logMeta.uploaded = recordSeq(&c);
+      }
+    }
+    complete = !nextRecord(&c, &d);
+    if (logMeta.uploaded != uploaded) writeLogMeta();
+  } else {
+    // older readers, one record per packet
+    while (nextRecord(&c, &d)) {
       uploadTagData(&d);
     }
   }
 
   sendAck();
+  setFastLink(false);
   PRINTLN("Upload complete");
-  isStopped = true;
+  #ifdef EEPROM_STATS
+    PRINT("SPI transactions: ");
+    PRINTLN(eeprom->transactions);
+  #endif
+  if (!(options & DL_OPT_RUN)) isStopped = true;
 
   switchToPingChannel();
+  return complete;
+}
+
+// Record sequence numbers count log records across the ring: the block
+// sequence number times RECORDS_PER_BLOCK, plus the record in the block.
+// Sequence number of the next record a cursor would send, or past the
+// last record once the cursor is done with the log.
+unsigned long Protocol::recordSeq(UploadCursor *c) {
+  unsigned int block = c->block;
+  byte record = c->record;
+
+  if (block >= logBlocks) {
+    // new records still go into the last block
+    block = logBlocks > 0 ? logBlocks - 1 : 0;
+    record = blockRecords;
+  }
+  return (unsigned long)(unsigned int)(tailSeq + block) * RECORDS_PER_BLOCK + record;
+}
+
+// Records from the tail of the log to a record sequence number. Records
+// that were overwritten since are at 0, the tail.
+unsigned long Protocol::recordPosition(unsigned long seq) {
+  unsigned int block = (unsigned int)(seq / RECORDS_PER_BLOCK) - tailSeq;
+
+  if (block > logBlocks) return 0;
+  return (unsigned long)block * RECORDS_PER_BLOCK + seq % RECORDS_PER_BLOCK;
 }
 
+// point a new cursor at a record sequence number
+void Protocol::seekRecord(UploadCursor *c, unsigned long seq) {
+  unsigned long position = recordPosition(seq);
+
+  c->block = position / RECORDS_PER_BLOCK;
+  c->record = position % RECORDS_PER_BLOCK;
+  if (c->record > 0 && c->block < logBlocks) {
+    readBlockHeader(c->block, &c->header);
+  }
+}
+
+// Next record to upload, false once all have been read
+boolean Protocol::nextRecord(UploadCursor *c, TagData *d) {
+  LogRecord r;
+  byte records;
+
+  while (c->block < logBlocks) {
+    records = (c->block == logBlocks - 1) ? blockRecords : RECORDS_PER_BLOCK;
+    if (c->record == 0) readBlockHeader(c->block, &c->header);
+    if (c->record < records) {
+      readRecord(c->block, c->record++, &r);
+      if (r.tagid != 0) {
+        if (r.end & RECORD_VOID) continue; // resumed later as another record
+        decodeRecord(&c->header, &r, d);
+        return true;
+      }
+    }
+
+    // end of the block, or it was closed early
+    c->block++;
+    c->record = 0;
+  }
+
+  if (c->slot < sessions.count) {
+    sessionToTagData(&sessions.entries[c->slot++], d);
+    return true;
+  }
+
+  return false;
+}
+
+// Send a window of PKT_BULK numbered from base, then poll the reader and
+// send the packets it missed again. Resent packets are rebuilt from the
+// log, so no RAM is needed to buffer them. Returns the packets in the
+// window, 0 when the upload is done or the reader does not answer.
+byte Protocol::uploadWindow(UploadCursor *c, unsigned int base, PeerDict *dict) {
+  UploadCursor start = *c;
+  UploadCursor r;
+  byte sent = 0;
+  byte missing;
+  byte tries = 0;
+  int ack;
+
+  while (sent < BULK_WINDOW && buildBulk(c, base + sent, dict) > 0) {
+    bulkWrite();
+    sent++;
+  }
+  if (sent == 0) return 0;
+
+  missing = (1 << sent) - 1;
+  while (tries < BULK_RETRIES) {
+    sendWindowPoll(base, sent);
+    ack = waitWindowAck(base);
+    if (ack < 0 || (missing & ~ack) == missing) {
+      tries++; // no progress, poll or ack lost
+      if (ack < 0) continue;
+    } else {
+      tries = 0;
+    }
+
+    missing &= ~ack;
+    if (missing == 0) return sent;
+
+    r = start;
+    for (byte k = 0; k < sent; k++) {
+      buildBulk(&r, base + k, dict);
+      if (missing & (1 << k)) bulkWrite();
+    }
+  }
+
+  PRINTLN("Reader stopped acking");
+  *c = start;
+  return 0;
+}
+
+// Fill the packet with the next records of the upload, packed if there
+// is a peer dictionary. Returns the number of records in it, 0 once
+// there are none left.
+byte Protocol::buildBulk(UploadCursor *c, unsigned int seq, PeerDict *dict) {
+  unsigned long firstSeconds;
+  unsigned int duration;
+  TagData d;
+  byte count = 0;
+  byte j = BULK_HEADER_LEN;
+
+  if (dict != NULL) return buildPacked(c, seq, dict);
+
+  while (count < BULK_RECORDS && nextRecord(c, &d)) {
+    firstSeconds = d.firstSeenSeconds - sessionStartSecs;
+    duration = d.lastSeenSeconds - d.firstSeenSeconds;
+    packet[j++] = d.tagid >> 8;
+    packet[j++] = d.tagid;
+    packet[j++] = firstSeconds >> 24;
+    packet[j++] = firstSeconds >> 16;
+    packet[j++] = firstSeconds >> 8;
+    packet[j++] = firstSeconds;
+    packet[j++] = duration >> 8;
+    packet[j++] = duration;
+    count++;
+  }
+
+  bulkHeader(PKT_BULK, seq, count);
+  packetLen = j;
+  return count;
+}
+
+// Fill the packet with as many packed records as fit. Packet 0 of a
+// packed upload is the peer dictionary instead.
+byte Protocol::buildPacked(UploadCursor *c, unsigned int seq, PeerDict *dict) {
+  UploadCursor before;
+  TagData d;
+  byte record[PACK_RECORD_MAX];
+  unsigned long prevFirst = 0;
+  byte count = 0;
+  byte j = BULK_HEADER_LEN;
+  byte n;
+
+  if (seq == 0) {
+    for (byte k = 0; k < PACK_DICT_SIZE; k++) {
+      packet[j++] = dict->ids[k] >> 8;
+      packet[j++] = dict->ids[k];
+    }
+    bulkHeader(PKT_DICT, seq, PACK_DICT_SIZE);
+    packetLen = j;
+    return PACK_DICT_SIZE;
+  }
+
+  while (true) {
+    before = *c;
+    if (!nextRecord(c, &d)) break;
+    n = packRecord(record, &d, prevFirst, dict);
+    if (j + n > sizeof(packet)) {
+      *c = before; // goes into the next packet
+      break;
+    }
+    memcpy(packet + j, record, n);
+    j += n;
+    prevFirst = d.firstSeenSeconds - sessionStartSecs;
+    count++;
+  }
+
+  bulkHeader(PKT_PACKED, seq, count);
+  packetLen = j;
+  return count;
+}
+
+// Pack a record for PKT_PACKED, returns its length
+byte Protocol::packRecord(byte *p, TagData *d, unsigned long prevFirst, PeerDict *dict) {
+  unsigned long first = d->firstSeenSeconds - sessionStartSecs;
+  long delta = first - prevFirst;
+  byte n = 0;
+  byte k = 0;
+
+  while (k < PACK_DICT_SIZE && dict->ids[k] != d->tagid) k++;
+  if (k < PACK_DICT_SIZE) {
+    p[n++] = k;
+  } else {
+    p[n++] = PACK_LITERAL;
+    p[n++] = d->tagid >> 8;
+    p[n++] = d->tagid;
+  }
+
+  // zigzag, so small negative differences stay short too
+  n += putVarint(p + n, ((unsigned long)delta << 1) ^ (unsigned long)(delta >> 31));
+  n += putVarint(p + n, (unsigned int)(d->lastSeenSeconds - d->firstSeenSeconds));
+  return n;
+}
+
+// write a varint, returns its length
+byte Protocol::putVarint(byte *p, unsigned long v) {
+  byte n = 0;
+
+  while (v >= 0x80) {
+    p[n++] = v | 0x80;
+    v >>= 7;
+  }
+  p[n++] = v;
+  return n;
+}
+
+// Count a peer for the dictionary of a packed upload. Misra-Gries: any
+// peer in more than 1 / (PACK_DICT_SIZE + 1) of the records gets an
+// entry, with no more RAM than the dictionary itself.
+void Protocol::countPeer(PeerDict *dict, unsigned int tagId) {
+  byte empty = PACK_DICT_SIZE;
+  byte k;
+
+  for (k = 0; k < PACK_DICT_SIZE; k++) {
+    if (dict->counts[k] > 0 && dict->ids[k] == tagId) {
+      if (dict->counts[k] < 0xFF) dict->counts[k]++;
+      return;
+    }
+    if (dict->counts[k] == 0) empty = k;
+  }
+
+  if (empty < PACK_DICT_SIZE) {
+    dict->ids[empty] = tagId;
+    dict->counts[empty] = 1;
+  } else {
+    for (k = 0; k < PACK_DICT_SIZE; k++) dict->counts[k]--;
+  }
+}
+
+// header shared by PKT_BULK, PKT_PACKED and PKT_DICT
+void Protocol::bulkHeader(byte type, unsigned int seq, byte count) {
+  unsigned long now = seconds() - sessionStartSecs;
+
+  packet[0] = type;
+  packet[1] = seq >> 8;
+  packet[2] = seq;
+  packet[3] = count;
+  packet[4] = now >> 24;
+  packet[5] = now >> 16;
+  packet[6] = now >> 8;
+  packet[7] = now;
+}
+
+// ask the reader which packets of the window it has
+void Protocol::sendWindowPoll(unsigned int base, byte sent) {
+  byte j = 0;
+  packet[j++] = PKT_WINDOW;
+  packet[j++] = tagid >> 8;
+  packet[j++] = tagid & 0xFF;
+  packet[j++] = base >> 8;
+  packet[j++] = base;
+  packet[j++] = sent;
+  packetLen = j;
+  bulkWrite();
+}
+
+// The reader prints records as they arrive and does not take packets
+// while its receive FIFO is full, so give it time to catch up. Lost
+// packets are still sent again once the reader acks the window.
+boolean Protocol::bulkWrite() {
+  unsigned long timer = millis();
+  while (!radioWrite()) {
+    if (TIME_INTERVAL(timer) > BULK_WRITE_MS) return false;
+  }
+  return true;
+}
+
+// bitmap of the window packets the reader has, -1 if it does not answer
+int Protocol::waitWindowAck(unsigned int base) {
+  unsigned long timer = millis();
+
+  radio->startListening();
+  while (TIME_INTERVAL(timer) < BULK_ACK_MS) {
+    if (radioRead() > 0 && packet[0] == CMD_WINDOW_ACK &&
+        getRemoteTagId(packet) == tagid &&
+        (((unsigned int)packet[3] << 8) | packet[4]) == base) {
+      return packet[5];
+    }
+  }
+
+  return -1;
+}
+
+// Send the log index: number of records that will follow from the
+// cursor on, their first and last timestamps and checksum, including the
+// sessions still in RAM. Then the download options the upload uses, and
+// the sequence numbers of the first log record sent and past the last.
+// Fills in the peer dictionary for packed uploads from the first
+// PACK_SAMPLE records. Only part of the log needs going through the
+// records, the index of the whole log is kept up to date.
+// Returns true if the reader acked the index. A try that was not acked
+// may still have reached the reader, which then went to the download
+// profile, so with DL_OPT_FAST the tries alternate between profiles.
+boolean Protocol::uploadIndex(UploadCursor *start, byte options, PeerDict *dict) {
+  unsigned long count = logMeta.records;
+  unsigned int checksum = logMeta.checksum;
+  unsigned long firstSeconds = logMeta.firstSeconds;
+  unsigned long lastSeconds = logMeta.lastSeconds;
+  unsigned long fromSeq = recordSeq(start);
+  unsigned long endSeq;
+  UploadCursor c = *start;
+  TagData d;
+
+  if (dict != NULL) {
+    for (unsigned int k = 0; k < PACK_SAMPLE && nextRecord(&c, &d); k++) {
+      countPeer(dict, d.tagid);
+    }
+    // drop the entries that lost their count
+    for (byte k = 0; k < PACK_DICT_SIZE; k++) {
+      if (dict->counts[k] == 0) dict->ids[k] = 0;
+    }
+  }
+
+  c = *start;
+  c.block = logBlocks;
+  endSeq = recordSeq(&c);
+  if (start->block > 0 || start->record > 0) {
+    // part of the log: go through the records
+    c = *start;
+    count = 0;
+    checksum = 0;
+  }
+
+  // the rest of the log, then the sessions in RAM
+  while (nextRecord(&c, &d)) {
+    if (count == 0 || d.firstSeenSeconds < firstSeconds) {
+      firstSeconds = d.firstSeenSeconds;
+    }
+    if (count == 0 || d.lastSeenSeconds > lastSeconds) {
+      lastSeconds = d.lastSeenSeconds;
+    }
+    count++;
+    checksum += d.tagid + (unsigned int)(d.lastSeenSeconds - d.firstSeenSeconds);
+  }
+
+  if (count == 0) {
+    firstSeconds = sessionStartSecs;
+    lastSeconds = sessionStartSecs;
+  }
+  firstSeconds -= sessionStartSecs;
+  lastSeconds -= sessionStartSecs;
+
+  byte j = 0;
+  packet[j++] = PKT_INDEX;
+  packet[j++] = count >> 24;
+  packet[j++] = count >> 16;
+  packet[j++] = count >> 8;
+  packet[j++] = count;
+  packet[j++] = firstSeconds >> 24;
+  packet[j++] = firstSeconds >> 16;
+  packet[j++] = firstSeconds >> 8;
+  packet[j++] = firstSeconds;
+  packet[j++] = lastSeconds >> 24;
+  packet[j++] = lastSeconds >> 16;
+  packet[j++] = lastSeconds >> 8;
+  packet[j++] = lastSeconds;
+  packet[j++] = checksum >> 8;
+  packet[j++] = checksum;
+  packet[j++] = options;
+  packet[j++] = fromSeq >> 24;
+  packet[j++] = fromSeq >> 16;
+  packet[j++] = fromSeq >> 8;
+  packet[j++] = fromSeq;
+  packet[j++] = endSeq >> 24;
+  packet[j++] = endSeq >> 16;
+  packet[j++] = endSeq >> 8;
+  packet[j++] = endSeq;
+  packetLen = j;
+
+  unsigned long timer = millis();
+  while (!radioWrite()) {
+    if (TIME_INTERVAL(timer) > BULK_WRITE_MS) {
+      setFastLink(false);
+      return false;
+    }
+    if (options & DL_OPT_FAST) setFastLink(!fastLink);
+  }
+  return true;
+}
+
+// convert a stored record back to absolute times
+void Protocol::decodeRecord(BlockHeader *header, LogRecord *r, TagData *d) {
+  d->tagid = r->tagid;
+  d->lastSeenSeconds = header->baseSeconds + (r->end & RECORD_OFFSET_MASK);
+  d->firstSeenSeconds = d->lastSeenSeconds - r->duration;
+}
+
+// RAM sessions keep 16-bit times, widen them relative to the current time
 void Protocol::sessionToTagData(SessionLookup *s, TagData *d) {
   d->tagid = s->tagid;
-  d->firstSeenSeconds = (unsigned long) s->firstSeenSeconds;
-  d->lastSeenSeconds = (unsigned long) s->lastSeenSeconds;
-  d->check = CHECK_BYTE;
+  d->lastSeenSeconds = seconds() - Sessions::age(s);
+  d->firstSeenSeconds = sessionStartSecs + s->start;
+  if (d->firstSeenSeconds > d->lastSeenSeconds) {
+    d->firstSeenSeconds = d->lastSeenSeconds; // start was capped
+  }
 }
 
 void Protocol::uploadTagData(TagData *d) {
@@ -469,23 +1393,49 @@ void Protocol::uploadTagData(TagData *d) {
 }
 
 void Protocol::resetData() {
-  // reset our data
-  unsigned int startAddr = EEPROM_DATA_START + sizeof(MetaData);
-  for (i = startAddr; i < EEPROM_SIZE; i += sizeof(TagData)) {
-    // check if we have tag data
-    readTagData(&d, i);
-    if (d.check == CHECK_BYTE) {
-      d.tagid = 0;
-      d.check = 0xff; // undo check byte
-      writeTagData(i, &d);
-    }
-  }  
-
-  for (i=0; i < MAX_RAM_SESSIONS; i++) {
-    sessions[i].tagid = 0;
+  // reset our data by starting a new generation, older records are stale
+  logMeta.generation++;
+  if (logMeta.generation == 0) {
+    // generation wrapped, so records left over from 256 resets ago
+    // would look current again
+    eraseLog();
   }
+  logMeta.tail = 0;
+  logMeta.dropped = 0;
+  logMeta.records = 0;
+  logMeta.firstSeconds = 0;
+  logMeta.lastSeconds = 0;
+  logMeta.checksum = 0;
+  logMeta.uploaded = 0;
+  logMeta.reserved = 0;
+  writeLogMeta();
+  logBlocks = 0;
+  blockRecords = 0;
+  tailSeq = 0;
+  stagedCount = 0;
+  stagedPartial = 0;
+  memset(spillTags, 0, sizeof(spillTags));
+
+  resetSessionData();
 
   PRINTLN("Data reset");
+  #ifdef EEPROM_STATS
+    PRINT("SPI transactions: ");
+    PRINTLN(eeprom->transactions);
+  #endif
+}
+
+// invalidate every block in EEPROM, whatever its generation
+void Protocol::eraseLog() {
+  byte check;
+  unsigned long addr;
+  for (unsigned int block = 0; block < logCapacity; block++) {
+    addr = EEPROM_LOG_START + (unsigned long)block * EEPROM_PAGE_SIZE;
+    eeprom->readBlock(addr, &check, 1);
+    if (check == BLOCK_CHECK) {
+      eeprom->write(addr, 0x00); // undo check byte
+    }
+  }
 }
 
 void Protocol::switchToDownloadChannel() {
@@ -496,6 +1446,21 @@ void Protocol::switchToDownloadChannel() {
   delay(1);
 }
 
+// Switch to the download profile and back. Dynamic payloads keep short
+// packets short on air, and need auto-ack, which downloads use anyway.
+void Protocol::setFastLink(boolean fast) {
+  if (fast) {
+    radio->setDataRate(FAST_SPEED);
+    radio->enableDynamicPayloads();
+    radio->setRetries(FAST_RETRY_DELAY, FAST_RETRY_COUNT);
+  } else {
+    radio->setDataRate(NRF_SPEED);
+    radio->disableDynamicPayloads();
+    radio->setRetries(5, 15); // RF24 defaults
+  }
+  fastLink = fast;
+}
+
 void Protocol::switchToPingChannel() {
   radio->setChannel(metaData.pingChannel);
   #ifdef AUTO_ACK
@@ -518,25 +1483,26 @@ void Protocol::switchToReaderChannel() {
 
 void Protocol::readMetaData() {
   // read data from eeprom
-  unsigned int addr = EEPROM_DATA_START;
-  for (int i = 0; i < sizeof(MetaData); i++) {
-    byte b = eeprom->read(addr + i);
-    *((byte *)&metaData + i) = b;
-  }  
+  eeprom->readBlock(EEPROM_DATA_START, (byte *)&metaData, sizeof(MetaData));
 }
 
 void Protocol::writeMetaData() {
-  unsigned int addr = EEPROM_DATA_START;
-  byte* bytes = reinterpret_cast<byte*>(&metaData);
-  for (int i = 0; i < sizeof(MetaData); i++) {
-    byte b = bytes[i];
-    byte d = eeprom->read(addr + i);
-    if (b != d) {
-      eeprom->write(addr + i, b);
-    }
+  // settings are often re-written unchanged, skip the write cycle then
+  MetaData stored;
+  eeprom->readBlock(EEPROM_DATA_START, (byte *)&stored, sizeof(MetaData));
+  if (memcmp(&stored, &metaData, sizeof(MetaData)) != 0) {
+    eeprom->writeBlock(EEPROM_DATA_START, (byte *)&metaData, sizeof(MetaData));
   }
 }
 
+void Protocol::readLogMeta() {
+  eeprom->readBlock(EEPROM_LOG_META, (byte *)&logMeta, sizeof(LogMeta));
+}
+
+void Protocol::writeLogMeta() {
+  eeprom->writeBlock(EEPROM_LOG_META, (byte *)&logMeta, sizeof(LogMeta));
+}
+
 void Protocol::setTXPower() {
   unsigned int txPower = 0;
   switch (metaData.pingTxRange & 0b01111111) {
@@ -571,11 +1537,39 @@ void Protocol::sendAckWithBatteryLevel() {
 }
 
 unsigned long Protocol::seconds() {
-  return millis() / 1000;
+  return Clock::seconds();
+}
+
+// time until the next session expires, for the sleep scheduler
+unsigned long Protocol::msToNextExpiry() {
+  if (sessions.count == 0) return 0xFFFFFFFF;
+
+  unsigned int untilDue = nextExpiry - (unsigned int)seconds();
+  if ((int)untilDue <= 0) return 0;
+  return untilDue * 1000UL - Clock::msIntoSecond();
+}
+
+// time until a wearable stops itself, for the sleep scheduler
+unsigned long Protocol::msToAutoStop() {
+  if (IS_LOCATOR(tagid) || isStopped) return 0xFFFFFFFF;
+
+  unsigned long running = TIME_INTERVAL2(seconds(), sessionStartSecs);
+  if (running > AUTO_STOP_SECONDS) return 0;
+  return (AUTO_STOP_SECONDS - running + 1) * 1000UL - Clock::msIntoSecond();
+}
+
+// staged sessions or the log index still have to go to EEPROM
+boolean Protocol::storagePending() {
+  return stagedCount > 0;
+}
+
+// session timeout as applied to RAM sessions
+unsigned int Protocol::sessionTimeout() {
+  return metaData.sessionTimeoutSecs;
 }
 
 unsigned int Protocol::secondsElapsed(unsigned int start) {
-  return ((unsigned int)(millis() / 1000)) - start;
+  return ((unsigned int)seconds()) - start;
 }
 
 void Protocol::resetMetaData() {
@@ -595,33 +1589,36 @@ void Protocol::resetMetaData() {
   metaData.listenPeriodSecs = LISTEN_PERIOD_SECS;
   metaData.readerPeriodSecs = READER_PERIOD_SECS;
   metaData.sessionTimeoutSecs = SESSION_TIMEOUT_SECS;
+  metaData.overflowPolicy = OVERFLOW_POLICY;
   writeMetaData();
 }
 
 void Protocol::loadTest() {
   // trigger test 1
-  if (millis() > 2000 & millis() < 3000) {
+  if (millis() > 2000 && millis() < 3000) {
     // create max sessions in RAM
     metaData.sessionTimeoutSecs = 1;
-    for (i = 0; i < MAX_RAM_SESSIONS; i++) {
-      sessions[i].tagid = i+1;
-      sessions[i].lastSeenSeconds = 0;
+    for (unsigned int j = 0; j < MAX_RAM_SESSIONS; j++) {
+      SessionLookup *s = getTagData(j+1);
+      if (s) s->lastSeen = seconds() + 1; // as old as it gets
     }
+    nextExpiry = seconds();
     delay(1000);
   }
 
   // trigger test 2
-  if (millis() > 6000 & millis() < 7000) {
+  if (millis() > 6000 && millis() < 7000) {
     PRINTLN("Test2");
 
     // create max sessions in RAM again (prev should have expired)
     metaData.sessionTimeoutSecs = 5;
-    for (i = 0; i < MAX_RAM_SESSIONS; i++) {
-      sessions[i].tagid = i+1;
-      sessions[i].lastSeenSeconds = 1;
+    for (unsigned int j = 0; j < MAX_RAM_SESSIONS; j++) {
+      SessionLookup *s = getTagData(j+1);
+      if (s) s->lastSeen = seconds() + 1;
     }
+    nextExpiry = seconds();
 
     delay(1000);
-    uploadData();
+    uploadData(0, 0);
   }
 }
@@ -10,45 +10,169 @@
 #include "eeprom.h"
 #include "global.h"
 #include "RF24.h"
+#include "clock.h"
+#include "sessions.h"
 
-#define CHECK_BYTE    0x5A
-#define TAGDATA_SIZE  sizeof(TagData)
+#define LOGMETA_CHECK 0xA7 // change when LogMeta changes, the log is reset
+
+// Session records form a circular log of blocks, one per EEPROM
+// page. The first page holds the tag id, settings and log bookkeeping.
+#define EEPROM_LOG_META   (EEPROM_DATA_START + sizeof(MetaData))
+#define EEPROM_LOG_START  EEPROM_PAGE_SIZE
+#define MAX_LOG_BLOCKS    0x7FFF // keeps block sequence numbers unambiguous
+#define RECORDS_PER_BLOCK ((EEPROM_PAGE_SIZE - sizeof(BlockHeader)) / sizeof(LogRecord))
+
+// On-EEPROM log format. Bump the version when the block layout changes,
+// blocks of another version are treated as free space.
+#define LOG_FORMAT_VERSION  1
+#define BLOCK_CHECK         (0xB0 | LOG_FORMAT_VERSION)
+#define RECORD_OFFSET_MASK  0x3FFF  // LogRecord.end: last seen offset
+#define RECORD_FLAGS_MASK   0xC000  // LogRecord.end: flags
+#define RECORD_PARTIAL      0x4000  // spilled from RAM, may be resumed
+#define RECORD_VOID         0x8000  // resumed in RAM, skip this record
+
+// Sessions are flushed roughly, not strictly, in last seen order. Base a
+// new block this many seconds before its first record so that slightly
+// older records still fit in it.
+#define BLOCK_BASE_SLACK    1024
 
 // Max sessions data to store in RAM. Adjust so that after compilation, 
-// memory usage is not more than 420 bytes out of 512 bytes
+// memory usage is not more than 420 bytes out of 512 bytes. A session
+// takes 6 bytes and 2 table slots; 24 would need 64 slots and 80 bytes
+// more than that leaves. Sessions beyond these spill to the log.
 #define MAX_RAM_SESSIONS  16
 
+// Slots of the session hash table, a power of 2 and at least twice
+// MAX_RAM_SESSIONS, one byte each. A full table still finds a free slot
+// for a new tag in about 1.5 compares.
+#define SESSION_SLOTS     32
+
+// RAM used by the Protocol object, checked at compile time. The rest of
+// the 512 bytes goes to the radio/EEPROM drivers, globals and the stack.
+#define PROTOCOL_RAM_BUDGET 270
+
+// Expired sessions are staged in RAM and written to EEPROM together
+#define STAGED_SESSIONS   2
+
+// Partial records of spilled sessions remembered by peer, 4 bytes each,
+// so a peer that comes back resumes its session from any block
+#define SPILL_INDEX       4
+
+// Bulk download: wait this long for the reader to ack a window, which
+// it does once it has printed the records. Give up after BULK_RETRIES.
+#define BULK_ACK_MS       500
+#define BULK_RETRIES      5
+
+// Keep retrying a bulk packet the reader does not ack for this long,
+// the time it takes to print a packed packet of records at 9600 baud.
+// Hardware retries alone are much shorter on the download profile.
+#define BULK_WRITE_MS     250
+
+// Packed uploads pick the dictionary peers from this many records at
+// the start, so the index goes out without reading the whole log
+#define PACK_SAMPLE       128
+
+// Inventory slot counter values, past the slots of any frame
+#define INVENTORY_WAIT    0xFF  // for the next frame
+#define INVENTORY_ANY     0xFD  // for the next beacon, in any frame
+#define INVENTORY_REPLIED 0xFE  // replied, the next beacon may ack it
+
+// A session with absolute times, as sent to the reader
 struct TagData {
   unsigned int tagid; // remote tag id
   unsigned long firstSeenSeconds; // session start time
   unsigned long lastSeenSeconds; // last seen time
-  byte check;
 };
 
-// Store session data in RAM. To mimize RAM usage (to store more sessions)
-// using only 2 bytes to store time, i.e. max 18.2 hours per session.
-struct SessionLookup {
-  unsigned int tagid; // remote tag id
-  unsigned int firstSeenSeconds; // session start time
-  unsigned int lastSeenSeconds; // last seen time
+// Header at the start of every log block. Record times in the block are
+// relative to baseSeconds, so each record needs only 16-bit times.
+struct BlockHeader {
+  uint8_t check; // BLOCK_CHECK, identifies the format version
+  uint8_t generation; // study generation the block was written in
+  uint16_t seq; // sequence number of the block in the log
+  uint32_t baseSeconds; // record times are relative to this
+};
+
+// A stored session, 6 bytes instead of the 11 of a TagData
+struct LogRecord {
+  uint16_t tagid; // remote tag id, 0 = free slot
+  uint16_t end; // last seen offset from baseSeconds, and flags
+  uint16_t duration; // seconds from first to last seen
 };
 
+// Session log bookkeeping stored in EEPROM. Blocks written under an
+// older generation are stale, so a data reset is a single write here.
+// Fields are in order of size, so there is no padding on any platform.
+struct LogMeta {
+  uint8_t generation; // current study generation
+  uint8_t check;
+  uint16_t tail; // physical block holding the oldest records
+  uint32_t dropped; // records dropped or overwritten on overflow
+
+  // index of the log, sent ahead of the data on download. Counted from
+  // the records at boot and kept in RAM, so page 0 is not written on
+  // every flush; the copy in EEPROM is not used.
+  uint32_t records; // records in the log
+  uint32_t firstSeconds; // earliest first seen time in the log
+  uint32_t lastSeconds; // latest last seen time in the log
+
+  uint32_t uploaded; // sequence number of the first record not yet acked on download
+  uint16_t checksum; // sum of tagid + duration over all records
+  uint16_t reserved; // 0, pads to a multiple of 4
+};
+
+// The log structs are stored as they are in EEPROM. Fixed width types
+// give them the same layout on the tag and on a host.
+STATIC_ASSERT(sizeof(BlockHeader) == 8, block_header_size);
+STATIC_ASSERT(sizeof(LogRecord) == 6, log_record_size);
+STATIC_ASSERT(sizeof(LogMeta) == 28, log_meta_size);
+
+// Position in an upload: the log records first, then the RAM sessions.
+// A copy of the cursor is enough to send the same records again.
+struct UploadCursor {
+  unsigned int block; // log block, logBlocks once the log is done
+  byte record; // next record in the block
+  byte slot; // next RAM session, after the log
+  BlockHeader header; // of the current block
+};
+
+// Peers of a packed upload, sent as a one byte index
+struct PeerDict {
+  unsigned int ids[PACK_DICT_SIZE]; // 0 = unused
+  byte counts[PACK_DICT_SIZE]; // while picking the peers
+};
+
+typedef SecondsClock Clock;
+typedef SessionTable<Clock, MAX_RAM_SESSIONS, SESSION_SLOTS> Sessions;
+
 class Protocol {
   public:
     static byte addr[];
     unsigned int tagid;
     MetaData metaData;
+    LogMeta logMeta;
     Eeprom *eeprom;
     RF24 *radio;
+    unsigned int lastReset; // millis() of the last reset, low 16 bits
+    unsigned long sessionStartSecs;
+    unsigned long blockBase; // base time of the last block
+    unsigned int nextExpiry; // no session expires before this (seconds)
+    unsigned int logCapacity; // blocks that fit in the EEPROM
+    unsigned int logBlocks; // blocks in the EEPROM log
+    unsigned int tailSeq; // sequence number of the oldest block
+    unsigned int inventoryRound; // last inventory round the tag was acked in
+    Sessions sessions; // store session lookup data in RAM
+    SessionLookup staged[STAGED_SESSIONS]; // expired, not yet in EEPROM
+    unsigned int spillTags[SPILL_INDEX]; // peers of partial records, newest first, 0 = none
+    unsigned int spillSeqs[SPILL_INDEX]; // their record sequence numbers, low 16 bits
+    byte blockRecords; // records in the last block
+    byte stagedCount;
+    byte stagedPartial; // bit n set: staged[n] was spilled, not expired
+    byte inventoryFrame; // frame the slot counter was picked for
+    byte inventorySlot; // beacons to go until the reply, or INVENTORY_*
+    boolean fastLink; // radio is on the download profile
     boolean isStopped;
     boolean noCommand;
-    unsigned long lastReset;
-    unsigned long sessionStartSecs;
-    SessionLookup sessions[MAX_RAM_SESSIONS]; // store session lookup data in RAM
-
-    // common variables
-    unsigned long i; // loop counter
-    TagData d; // tag data
 
     // packet buffer for radio
     byte packet[32];
@@ -58,35 +182,81 @@ class Protocol {
     void begin(unsigned int tagId, RF24 *radio, Eeprom *eeprom);
     void process(byte* inbuf, int len);
     void tick();
+    void flushStaged();
+    void pollStorage();
     void clearBuffer();
     void resetData();
     void switchToPingChannel();
     void switchToReaderChannel();
     void switchToDownloadChannel();
+    void setFastLink(boolean fast);
     void readMetaData();
     void writeMetaData();
     void resetMetaData();
+    void readLogMeta();
+    void writeLogMeta();
     void resetSessionData();
     void setTXPower();
     unsigned long seconds();
+    unsigned long msToNextExpiry();
+    unsigned long msToAutoStop();
+    boolean storagePending();
     void writeSetting(byte *inbuf, int len);
+    boolean handleInventory(byte *inbuf, int len);
     byte batteryLevel();
     int radioRead();
-    void radioWrite();
+    boolean radioWrite();
 
   private:
+    friend struct HostTest; // host/tag.h, reaches in for the host tests
+
     unsigned int getRemoteTagId(byte* inbuf);
     SessionLookup* getTagData(unsigned int tagId);    
-    void readTagData(TagData *tagData, unsigned long addr);    
+    void expireSessions();
+    unsigned int sessionTimeout();
+    boolean spillSession();
+    boolean resumeSession(SessionLookup *s);
+    boolean resumeRecord(SessionLookup *s, unsigned int seq);
+    void indexSpill(unsigned int tagId, unsigned long seq);
+    unsigned long blockAddr(unsigned int block);
+    unsigned long recordAddr(unsigned int block, byte record);
+    boolean readBlockHeader(unsigned int block, BlockHeader *header);
+    void readRecord(unsigned int block, byte record, LogRecord *r);
+    boolean fitsBlock(unsigned long lastSeenSeconds);
+    void writeStaged();
+    boolean handleOverflow();
+    void addToIndex(TagData *tagData);
+    void decodeRecord(BlockHeader *header, LogRecord *r, TagData *tagData);
+    void findWriteCursor();
+    void countIndex();
+    void eraseLog();
     void sessionToTagData(SessionLookup *s, TagData *tagData);
-    void writeTagData(unsigned long addr, TagData *tagData);    
     void relay(byte command);
     void sendAck();
     void sendAckWithBatteryLevel(); // uses some battery, use sparingly
-    void uploadData();
+    void download(byte *inbuf, int len);
+    boolean uploadData(byte options, unsigned long since);
+    boolean uploadIndex(UploadCursor *start, byte options, PeerDict *dict);
+    unsigned long recordSeq(UploadCursor *c);
+    unsigned long recordPosition(unsigned long seq);
+    void seekRecord(UploadCursor *c, unsigned long seq);
+    boolean nextRecord(UploadCursor *c, TagData *tagData);
+    byte buildBulk(UploadCursor *c, unsigned int seq, PeerDict *dict);
+    byte buildPacked(UploadCursor *c, unsigned int seq, PeerDict *dict);
+    byte packRecord(byte *p, TagData *tagData, unsigned long prevFirst, PeerDict *dict);
+    byte putVarint(byte *p, unsigned long v);
+    void countPeer(PeerDict *dict, unsigned int tagId);
+    void bulkHeader(byte type, unsigned int seq, byte count);
+    void sendWindowPoll(unsigned int base, byte sent);
+    int waitWindowAck(unsigned int base);
+    boolean bulkWrite();
+    byte uploadWindow(UploadCursor *c, unsigned int base, PeerDict *dict);
     void uploadSettings(byte *inbuf, int len);
     void uploadTagData(TagData *d);
     void handlePing(byte *inbuf, int len);
+    void handleBroadcast(byte *inbuf, int len);
+    void startLogging();
+    void stopLogging();
     void handleDownload(byte *inbuf, int len);
     unsigned int secondsElapsed(unsigned int start);
     void loadTest();
@@ -0,0 +1,144 @@
+/**
+ * Copyright 2022 IBM Corp. All Rights Reserved.
+ */
+
+#ifndef _RFT_SESSIONS_H
+#define _RFT_SESSIONS_H
+
+#include <Energia.h>
+
+// C++98 has no static_assert, fail the build with a negative array size
+#define STATIC_ASSERT(cond, name) typedef char static_assert_##name[(cond) ? 1 : -1]
+
+// Store session data in RAM, 16-bit times to store more sessions. The
+// start time is relative to sessionStartSecs (max 18.2 hours, tags
+// auto-stop after 12), the last seen time is kept mod 65536, so ages
+// stay right however long the tag is busy, e.g. with a download.
+struct SessionLookup {
+  unsigned int tagid; // remote tag id, all 16 bits as locators are > 32767
+  unsigned int start; // first seen, seconds since sessionStartSecs
+  unsigned int lastSeen; // low 16 bits of the last seen time
+};
+
+// RAM sessions, packed in entries[], found through an open-addressing
+// hash table on the remote tagid. The table holds one byte per slot, so
+// it is kept at most half full for a few bytes of RAM. Header only, so
+// calls are inlined on the tag, and the clock and size can be swapped
+// out to run the table on a host.
+//   Clock     class with a static seconds()
+//   CAPACITY  max sessions held
+//   SLOTS     table size, a power of 2 and at least 2 * CAPACITY. A probe
+//             then ends at a free slot after 1.5 compares on average,
+//             however many sessions are held.
+template <class Clock, byte CAPACITY, byte SLOTS>
+class SessionTable {
+  public:
+    enum {
+      capacity = CAPACITY,
+      slots = SLOTS,
+      mask = SLOTS - 1
+    };
+
+    SessionLookup entries[CAPACITY]; // sessions, the first count are used
+    byte table[SLOTS]; // 1 + index in entries, 0 = free slot
+    byte count; // sessions in the table
+
+    void clear() {
+      for (byte j=0; j < SLOTS; j++) {
+        table[j] = 0;
+      }
+      count = 0;
+    }
+
+    boolean full() {
+      return count >= CAPACITY;
+    }
+
+    // session of a tag, NULL if there is none
+    SessionLookup *find(unsigned int tagId) {
+      byte slot = lookup(tagId);
+      return table[slot] ? &entries[table[slot] - 1] : NULL;
+    }
+
+    // Add a session for a tag that has none, with the times left for
+    // the caller to fill in. NULL if the table is full.
+    SessionLookup *insert(unsigned int tagId) {
+      if (full()) return NULL;
+
+      table[lookup(tagId)] = count + 1;
+      entries[count].tagid = tagId;
+      return &entries[count++];
+    }
+
+    // Remove entries[n]. The last session moves into its place. In the
+    // table, rather than leaving a tombstone, move later slots of the
+    // probe run back so that lookups still stop at the first free slot.
+    void remove(byte n) {
+      byte slot = lookup(entries[n].tagid);
+      byte next = slot;
+
+      count--;
+      if (n != count) {
+        table[lookup(entries[count].tagid)] = n + 1;
+        entries[n] = entries[count];
+      }
+
+      table[slot] = 0;
+      while (true) {
+        next = (next + 1) & mask;
+        if (table[next] == 0) break;
+
+        // a session can fill the hole if its home slot is not cyclically
+        // between the hole and where it is now
+        if (((next - home(entries[table[next] - 1].tagid)) & mask) >=
+            ((next - slot) & mask)) {
+          table[slot] = table[next];
+          table[next] = 0;
+          slot = next;
+        }
+      }
+    }
+
+    // seconds since a session was last seen, valid up to 65535
+    static unsigned int age(const SessionLookup *s) {
+      return (unsigned int)Clock::seconds() - s->lastSeen;
+    }
+
+    // index in entries of the least recently seen session
+    byte oldest() {
+      byte lru = 0;
+      unsigned int a;
+      unsigned int max = 0;
+
+      for (byte j=0; j < count; j++) {
+        if ((a = age(&entries[j])) >= max) {
+          lru = j;
+          max = a;
+        }
+      }
+      return lru;
+    }
+
+  private:
+    friend struct HostTest; // host/tag.h, reaches in for the host tests
+
+    STATIC_ASSERT((SLOTS & (SLOTS - 1)) == 0, slots_is_power_of_2);
+    STATIC_ASSERT(SLOTS >= 2 * CAPACITY, slots_at_most_half_full);
+
+    // home slot of a tag. Tag ids are mostly handed out in sequence,
+    // fold the high bits in so locators spread too.
+    static byte home(unsigned int tagId) {
+      return (tagId ^ (tagId >> 4) ^ (tagId >> 8)) & mask;
+    }
+
+    // slot of a tag's session, or the free slot that ends its probe run
+    byte lookup(unsigned int tagId) {
+      byte slot = home(tagId);
+      while (table[slot] != 0 && entries[table[slot] - 1].tagid != tagId) {
+        slot = (slot + 1) & mask;
+      }
+      return slot;
+    }
+};
+
+#endif